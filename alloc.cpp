@@ -0,0 +1,35 @@
+#include <iomanip>
+#include "alloc.h"
+#include "lexer.h"
+
+using namespace std;
+using namespace Alloc;
+
+thread_local Count Alloc::counts[types] {};
+
+const char* Alloc::name(Type t) {
+    static const char* names[types] {"cell", "list", "env", "proc", "string"};
+    return names[t];
+}
+
+Lexer::Cell Alloc::report() {
+    using Lexer::Cell;
+    using Lexer::List;
+    if (!enabled) throw runtime_error("alloc-stats are only kept by clisp-alloc (make alloc)");
+    auto count = [](size_t n) { return Cell{static_cast<long long>(n)}; };
+    List res;
+    for (int t = 0; t < types; ++t) {
+        const Count& c = counts[t];
+        res.push_back(List{name(Type(t)), List{"made", count(c.made)}, List{"copied", count(c.copied)},
+            List{"moved", count(c.moved)}, List{"bytes", count(c.bytes)}});
+    }
+    return res;
+}
+
+void Alloc::dump(ostream& os) {
+    os << setw(8) << "type" << setw(14) << "made" << setw(14) << "copied" << setw(14) << "moved" << setw(14) << "bytes\n";
+    for (int t = 0; t < types; ++t) {
+        const Count& c = counts[t];
+        os << setw(8) << name(Type(t)) << setw(14) << c.made << setw(14) << c.copied << setw(14) << c.moved << setw(13) << c.bytes << '\n';
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef clispp_alloc
+#define clispp_alloc
+#include <cstddef>
+#include <iosfwd>
+#include "forward.h"
+
+#ifndef CLISP_ALLOC
+#define CLISP_ALLOC 0
+#endif
+
+// constructions, copies, moves and bytes allocated of the interpreter's value types, for finding copies to
+// eliminate. built in by make alloc (-DCLISP_ALLOC), otherwise every count is behind a false constant,
+// and Tally is an empty base taking no room
+namespace Alloc {
+    using namespace std;
+
+    constexpr bool enabled {CLISP_ALLOC != 0};
+
+    enum Type { Cells, Lists, Envs, Procs, Strings, types };   // lists and strings are the payloads of cells
+    const char* name(Type t);
+
+    struct Count {
+        size_t made, copied, moved, bytes;
+    };
+    extern thread_local Count counts[types];   // of the thread, so of the interpreter it uses
+
+    inline void made(Type t) { if (enabled) ++counts[t].made; }
+    inline void copied(Type t) { if (enabled) ++counts[t].copied; }
+    inline void moved(Type t) { if (enabled) ++counts[t].moved; }
+    inline void bytes(Type t, size_t n) { if (enabled) counts[t].bytes += n; }
+
+    template <Type t>
+    struct Tally {  // base of a counted type, whose constructors and assignments it sees
+        Tally() { made(t); }
+        Tally(const Tally&) { copied(t); }
+        Tally(Tally&&) noexcept { moved(t); }
+        Tally& operator=(const Tally&) { copied(t); return *this; }
+        Tally& operator=(Tally&&) noexcept { moved(t); return *this; }
+    };
+
+    Lexer::Cell report();   // (alloc-stats), one list of counts per type
+    void dump(ostream& os);     // as a table
+}
+#endif
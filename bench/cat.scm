@@ -0,0 +1,6 @@
+; string concatenation in a loop
+(define (cat-loop n s)
+        (cond ((= n 0) s)
+              (else (cat-loop (- n 1) (cat 'ab s)))))
+
+(define (bench) (empty? (cat-loop 2000 'x)))
@@ -0,0 +1,8 @@
+; deep chains of closures made by compose from funcs.scm
+(include funcs.scm)
+
+(define (nest k f)
+        (cond ((= k 0) (compose inc f))     ; a procedure named on its own would be called
+              (else (nest (- k 1) (compose inc f)))))
+
+(define (bench) (let ((g (nest 300 inc))) (g 0)))
@@ -0,0 +1,8 @@
+; iterative fibonacci from funcs.scm run many times, tail calls only
+(include funcs.scm)
+
+(define (fib-iter-loop k acc)
+        (cond ((= k 0) acc)
+              (else (fib-iter-loop (- k 1) (fib 60)))))
+
+(define (bench) (fib-iter-loop 500 0))
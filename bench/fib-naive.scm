@@ -0,0 +1,6 @@
+; doubly recursive fibonacci, dominated by procedure calls and arithmetic
+(define (fib-naive-n x)
+        (cond ((< x 2) x)
+              (else (+ (fib-naive-n (- x 1)) (fib-naive-n (- x 2))))))
+
+(define (bench) (fib-naive-n 22))
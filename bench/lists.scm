@@ -0,0 +1,12 @@
+; map, filter and reduce from funcs.scm over a large list
+(include funcs.scm)
+
+(define (build n acc)
+        (cond ((= n 0) acc)
+              (else (build (- n 1) (cons n acc)))))
+
+(define big-list (build 20000 ()))
+
+(define (small? x) (< x 10000))
+
+(define (bench) (reduce add 0 (map inc (filter small? big-list))))
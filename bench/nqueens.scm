@@ -0,0 +1,21 @@
+; counts the solutions to n queens, placed columns kept in a list
+(define (safe? col dist placed)
+        (cond ((empty? placed) (= 0 0))
+              ((= (car placed) col) (= 0 1))
+              ((= (car placed) (+ col dist)) (= 0 1))
+              ((= (car placed) (- col dist)) (= 0 1))
+              (else (safe? col (+ dist 1) (cdr placed)))))
+
+(define (place col row n placed)
+        (cond ((safe? col 1 placed) (queens-from 0 (+ row 1) n (cons col placed)))
+              (else 0)))
+
+(define (queens-from col row n placed)
+        (cond ((= row n) 1)
+              ((= col n) 0)
+              (else (+ (place col row n placed)
+                       (queens-from (+ col 1) row n placed)))))
+
+(define (queens n) (queens-from 0 0 n ()))
+
+(define (bench) (queens 7))
@@ -0,0 +1,97 @@
+#ifndef clispp_bytecode
+#define clispp_bytecode
+#include <memory>
+#include <string>
+#include <vector>
+#include "forward.h"
+#include "lexer.h"
+
+namespace Bytecode {
+    using namespace std;
+    using Lexer::Cell;
+    using Lexer::List;
+    using Lexer::Symbol;
+    using Environment::Env;
+
+    // a list being evaluated keeps its results on the stack above a list mark,
+    // procedures and primitives inside it leave call marks to be resolved at the end of the list
+    enum class Op : unsigned char {
+        Const,      // push consts[a]
+        Name,       // push value of globals[a], a procedure outside of argument position starts a call
+        Local,      // Name for slot a & 0xffff of frame a >> 16 levels out
+        Checked,    // Name for the first bound address in addrs[a]
+        Head,       // Name for first name of an evaluated form, non procedures skip to b
+        HeadLocal,
+        HeadChecked,
+        Prim,       // push primitive consts[a] and start a call over the rest of the list
+        Mark,       // start of a list
+        Resolve,    // apply pending calls of the current list, innermost first
+        Tail,       // resolve, reusing the frame if the outermost call is the last thing done
+        Collect,    // end of list, a single result is left as is, any other number becomes a List
+        Drop,       // end of list, discarding results
+        Pop,
+        Jump,       // to a
+        False,      // pop and jump to a if false
+        Lambda,     // push new procedure made from procs[a]
+        Define,     // bind names[a] to top of stack in current environment
+        DefineLocal,    // store top of stack in slot a of current frame
+        Let,        // new frame laid out by lets[a] holding the top values
+        Unlet,      // back to enclosing environment
+        Include,    // switch input to file names[a]
+        Profile,    // start a profile
+        Unprofile,  // end it, reporting if it is the outermost
+        Return,
+        Error       // throw message consts[a]
+    };
+
+    enum class Seen : unsigned char {   // operands a Prim has been resolved on
+        Nothing,
+        Numbers,    // only numbers so far, for the arithmetic and comparisons the VM does itself
+        Other
+    };
+
+    struct Instr {
+        Op op;
+        int a;
+        int b;
+        mutable Seen seen;  // type feedback of Prim
+    };
+
+    inline int local(int depth, int slot) { return depth << 16 | slot; }
+
+    struct Global {     // name not bound in any enclosing lambda or let, looked up from frame depth levels out
+        const Symbol* name;
+        int depth;
+        mutable Env* start;     // cached binding, valid while lookups start at the same frame
+        mutable Cell* cell;
+    };
+
+    struct Address {    // frame depth and slot, or -1 - index into globals
+        int depth;
+        int slot;
+    };
+
+    struct Layout {     // frame of a procedure call or let
+        int size;
+        vector<int> bind;   // slot of each parameter or let name
+    };
+
+    struct Template {  // procedure created by evaluating lambda or define
+        Cell params;
+        Cell body;
+        shared_ptr<Code> code;
+    };
+
+    struct Code {
+        vector<Instr> instrs;
+        List consts;
+        vector<const Symbol*> names;
+        vector<Global> globals;
+        vector<vector<Address>> addrs;  // names that may be referenced before their define, innermost first
+        vector<Layout> lets;
+        vector<Template> procs;
+        Layout frame;   // for procedure bodies
+        bool captures {false};  // makes procedures, which keep its frames and lets alive after it returns
+    };
+}
+#endif
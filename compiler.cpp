@@ -0,0 +1,375 @@
+#include "compiler.h"
+#include "parser_impl.h"
+#include "error.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace Bytecode;
+
+namespace {
+    using Iter = List::const_iterator;
+
+    struct Scope {  // names of a frame made for a lambda or let
+        vector<const Symbol*> names;
+        int bound {0};  // parameters and let names, which are bound before anything in the frame runs
+
+        int slot(const Symbol* n) const {
+            for (size_t i = 0; i < names.size(); ++i)
+                if (names[i] == n) return i;
+            return -1;
+        }
+        int add(const Symbol* n) {
+            int s {slot(n)};
+            if (s >= 0) return s;
+            names.push_back(n);
+            return names.size() - 1;
+        }
+    };
+    using Chain = vector<const Scope*>;     // innermost scope last
+
+    void scan(Iter b, Iter e, Scope& scope);
+    Layout layout(const List& names, Scope& scope, Iter b, Iter e);
+    shared_ptr<Code> procedure(const List& params, const List& body, const Chain& outer);
+
+    class Emitter {
+    public:
+        Emitter(Code& c, const Chain& outer) : code(c), chain(outer) {}
+        void form(Iter b, Iter e, bool tail);  // code for eval, leaves one value
+        void items(Iter b, Iter e);     // code for evlist, leaves results above current mark
+    private:
+        Code& code;
+        Chain chain;
+
+        int emit(Op op, int a = 0, int b = 0) { code.instrs.push_back({op, a, b}); return code.instrs.size() - 1; }
+        int here() const { return code.instrs.size(); }
+        void patch(int at) { code.instrs[at].a = here(); }
+        int constant(const Cell& c) { code.consts.push_back(c); return code.consts.size() - 1; }
+        int name(const Symbol* n);
+        int global(const Symbol* n, int depth);
+        int load(const Symbol* n, bool head);
+        void define(const Symbol* n);
+        void error(const string& msg) { emit(Op::Error, constant(Cell{msg})); }
+
+        void sublist(const List& l, bool tail);
+        void lambda(const Cell& params, const Cell& body);
+        void let(Iter p, Iter e, bool tail);
+        void cond(Iter p, Iter e, bool tail);
+    };
+
+    bool is_prim(Kind k) {
+        switch (k) {
+            case Kind::Add: case Kind::Sub: case Kind::Mul: case Kind::Div: case Kind::Less: case Kind::Greater: case Kind::Equal:
+            case Kind::Cat: case Kind::Cons: case Kind::Car: case Kind::Cdr: case Kind::List: case Kind::And: case Kind::Or: case Kind::Not:
+            case Kind::Empty: case Kind::GcStats: case Kind::AllocStats: case Kind::Modulo: case Kind::Quotient:
+            case Kind::Touch: case Kind::Pmap: case Kind::Preduce: return true;
+            default: return false;
+        }
+    }
+
+    constexpr size_t max_slots {1 << 16};
+
+    void scan(Iter b, Iter e, Scope& scope) {   // names defined in a body, ahead of the define being evaluated
+        for (auto p = b; p != e; ++p) {
+            switch (p->kind) {
+                case Kind::Quote: if (p + 1 != e) ++p; break;
+                case Kind::Lambda: p += min<ptrdiff_t>(2, e - p - 1); break;    // own scope
+                case Kind::Define:
+                    if (p + 1 == e) break;
+                    if (p[1].kind == Kind::Name) scope.add(p[1].sym());
+                    else if (p[1].kind == Kind::Expr) {
+                        const List& declaration = p[1].list();
+                        if (declaration.size() && declaration[0].kind == Kind::Name) scope.add(declaration[0].sym());
+                        p += min<ptrdiff_t>(2, e - p - 1);
+                    }
+                    break;
+                case Kind::Let:     // values belong to this scope, body to the let's
+                    if (p + 1 != e && p[1].kind == Kind::Expr)
+                        for (auto& pair : p[1].list())
+                            if (pair.kind == Kind::Expr && pair.list().size() > 1)
+                                scan(pair.list().begin() + 1, pair.list().begin() + 2, scope);
+                    p += min<ptrdiff_t>(2, e - p - 1);
+                    break;
+                case Kind::Expr: scan(p->list().begin(), p->list().end(), scope); break;
+                default: break;
+            }
+        }
+    }
+
+    Layout layout(const List& names, Scope& scope, Iter b, Iter e) {
+        Layout l;
+        for (auto& n : names) l.bind.push_back(scope.add(n.sym()));
+        scope.bound = scope.names.size();
+        scan(b, e, scope);
+        if (scope.names.size() >= max_slots) throw runtime_error("Too many names in one scope");
+        l.size = scope.names.size();
+        return l;
+    }
+
+    shared_ptr<Code> procedure(const List& params, const List& body, const Chain& outer) {
+        auto code = make_shared<Code>();
+        Scope scope;
+        code->frame = layout(params, scope, body.begin(), body.end());
+        Chain chain {outer};
+        chain.push_back(&scope);
+        Emitter{*code, chain}.form(body.begin(), body.end(), true);
+        code->instrs.push_back({Op::Return, 0, 0});
+        return code;
+    }
+}
+
+int Emitter::name(const Symbol* n) {
+    for (size_t i = 0; i < code.names.size(); ++i)
+        if (code.names[i] == n) return i;
+    code.names.push_back(n);
+    return code.names.size() - 1;
+}
+
+int Emitter::global(const Symbol* n, int depth) {
+    for (size_t i = 0; i < code.globals.size(); ++i)
+        if (code.globals[i].name == n && code.globals[i].depth == depth) return i;
+    code.globals.push_back({n, depth, nullptr, nullptr});
+    return code.globals.size() - 1;
+}
+
+int Emitter::load(const Symbol* n, bool head) {  // resolve n to the frame and slot holding it
+    vector<Address> addrs;
+    bool bound {false};
+    int depth {0};
+    for (auto s = chain.rbegin(); s != chain.rend() && !bound; ++s, ++depth) {
+        int slot {(*s)->slot(n)};
+        if (slot < 0) continue;
+        addrs.push_back({depth, slot});
+        bound = slot < (*s)->bound;     // a defined name may still be unbound when referenced
+    }
+    if (!bound) addrs.push_back({depth, -1 - global(n, depth)});
+    if (addrs.size() > 1) {
+        code.addrs.push_back(addrs);
+        return emit(head? Op::HeadChecked : Op::Checked, code.addrs.size() - 1);
+    }
+    if (bound) return emit(head? Op::HeadLocal : Op::Local, local(addrs[0].depth, addrs[0].slot));
+    return emit(head? Op::Head : Op::Name, -1 - addrs[0].slot);
+}
+
+void Emitter::define(const Symbol* n) {
+    if (chain.empty()) emit(Op::Define, name(n));
+    else emit(Op::DefineLocal, chain.back()->slot(n));  // found by scan
+}
+
+void Emitter::sublist(const List& l, bool tail) {  // (... (expr) ...)
+    if (l.size() && (l[0].kind == Kind::Begin || l[0].kind == Kind::Let)) {
+        form(l.begin(), l.end(), tail);     // the single result evlist gives, but keeping the tail position
+        return;
+    }
+    emit(Op::Mark);
+    items(l.begin(), l.end());
+    emit(tail? Op::Tail : Op::Resolve);
+    emit(Op::Collect);
+}
+
+void Emitter::lambda(const Cell& params, const Cell& body) {
+    if (params.kind != Kind::Expr || body.kind != Kind::Expr) { error(bad_get); return; }
+    const List& p = params.list();
+    for (auto& n : p) if (n.kind != Kind::Name) { error(bad_get); return; }
+    code.procs.push_back({params, body, procedure(p, body.list(), chain)});
+    code.captures = true;   // the only way a frame outlives its call
+    emit(Op::Lambda, code.procs.size() - 1);
+}
+
+void Emitter::let(Iter p, Iter e, bool tail) {  // (let ((name val) ...) body)
+    if (p + 2 >= e) { error("Let expects a list of definitions and a body"); return; }
+    if ((++p)->kind != Kind::Expr) { error(bad_get); return; }
+    List names;
+    for (auto& pair : p->list()) {  // values are evaluated in the enclosing environment
+        if (pair.kind != Kind::Expr || pair.list().size() < 2 || pair.list()[0].kind != Kind::Name) {
+            error(bad_get); return;
+        }
+        const List& def = pair.list();
+        form(def.begin() + 1, def.begin() + 2, false);
+        names.push_back(def[0]);
+    }
+    ++p;
+    Iter b {p}, e2 {p + 1};
+    if (p->kind == Kind::Expr) { b = p->list().begin(); e2 = p->list().end(); }
+    Scope scope;
+    code.lets.push_back(layout(names, scope, b, e2));
+    emit(Op::Let, code.lets.size() - 1);
+    chain.push_back(&scope);
+    form(b, e2, tail);
+    chain.pop_back();
+    emit(Op::Unlet);
+}
+
+void Emitter::cond(Iter p, Iter e, bool tail) {  // (cond ((pred) expr...) ... (else expr))
+    vector<int> ends;
+    while (++p != e) {
+        if (p->kind != Kind::Expr) { error(bad_get); break; }
+        const List& clause = p->list();
+        if (clause.size() == 0) { error("Empty clause in condition"); break; }
+        if (clause[0].kind == Kind::Else) {
+            if (p + 1 != e) error("Else clause not at end of condition");
+            else if (clause.size() < 2) error("Else clause expects an expression");
+            else { form(clause.begin() + 1, clause.begin() + 2, tail); ends.push_back(emit(Op::Jump)); }
+            break;
+        }
+        form(clause.begin(), clause.begin() + 1, false);
+        int next = emit(Op::False);
+        form(clause.begin() + 1, clause.end(), tail);
+        ends.push_back(emit(Op::Jump));
+        patch(next);
+    }
+    if (p == e) error("No matching clause in condition");
+    for (int end : ends) patch(end);
+}
+
+void Emitter::form(Iter b, Iter e, bool tail) {
+    if (b == e) { emit(Op::Const, constant(Cell{})); return; }
+    auto p = b;
+    switch (p->kind) {
+        case Kind::Include:
+            if (p + 1 == e || p[1].kind != Kind::Name) error(bad_get);
+            else emit(Op::Include, name(p[1].sym()));
+            return;
+        case Kind::Number: case Kind::Integer: emit(Op::Const, constant(*p)); return;
+        case Kind::Quote:
+            if (p + 1 == e) error("Quote expects 1 arg");
+            else emit(Op::Const, constant(p[1]));
+            return;
+        case Kind::Begin:       // (begin a b c d ... return)
+            if (p + 1 == e) { error("Begin expects at least 1 expression"); return; }
+            emit(Op::Mark);
+            items(p + 1, e - 1);
+            emit(Op::Resolve);
+            emit(Op::Drop);
+            form(e - 1, e, tail);
+            return;
+        case Kind::Profile:     // (profile expr), giving the value of expr
+            if (p + 1 == e) { error("Profile expects an expression"); return; }
+            emit(Op::Profile);
+            form(p + 1, e, false);
+            emit(Op::Unprofile);
+            return;
+        case Kind::Future:      // (future expr), a call of the future primitive on a procedure made from expr
+            if (p + 1 == e) { error("Future expects an expression"); return; }
+            emit(Op::Mark);
+            emit(Op::Prim, constant(*p));
+            lambda(Cell{List{}}, Cell{List(p + 1, e)});
+            emit(Op::Resolve);
+            emit(Op::Collect);
+            return;
+        case Kind::Lambda:      // (lambda (params) (body))
+            if (p + 2 >= e) error("Malformed lambda expression");
+            else lambda(p[1], p[2]);
+            return;
+        case Kind::Define: {    // (define name expr) or (define (func args) (body))
+            if (p + 2 >= e) { error("Malformed define expression"); return; }
+            auto np = p + 1;
+            if (np->kind == Kind::Name) {
+                form(p + 2, e, false);
+                define(np->sym());
+            }
+            else if (np->kind == Kind::Expr) {
+                const List& declaration = np->list();
+                if (declaration.size() == 0 || declaration[0].kind != Kind::Name) { error(bad_get); return; }
+                lambda(Lexer::tail(*np), p[2]);
+                define(declaration[0].sym());
+            }
+            else error("Unfamiliar form to define");
+            return;
+        }
+        case Kind::Expr: sublist(p->list(), tail); return;
+        case Kind::Let: let(p, e, tail); return;
+        case Kind::Cond: cond(p, e, tail); return;
+        case Kind::Name: {  // value, or procedure applied to the rest of the form
+            emit(Op::Mark);
+            int skip = load(p->sym(), true);
+            items(p + 1, e);
+            emit(tail? Op::Tail : Op::Resolve);
+            code.instrs[skip].b = here();
+            emit(Op::Collect);
+            return;
+        }
+        default:
+            if (!is_prim(p->kind)) { error("Unmatched cell in eval"); return; }
+            if (p + 1 == e && !Parser::nullary(p->kind)) { error("Primitives take at least one argument"); return; }
+            emit(Op::Mark);
+            emit(Op::Prim, constant(*p));
+            items(p + 1, e);
+            emit(Op::Resolve);
+            emit(Op::Collect);
+            return;
+    }
+}
+
+void Emitter::items(Iter b, Iter e) {
+    vector<int> ends;                       // forms that return the list early
+    vector<vector<int>> resume(e - b + 1);  // cond in evlist carries on after the matching clause
+    auto p = b;
+    for (; p != e; ++p) {
+        for (int at : resume[p - b]) patch(at);
+        resume[p - b].clear();
+        switch (p->kind) {
+            case Kind::Include:
+                form(p, e, false);
+                ends.push_back(emit(Op::Jump));
+                goto done;
+            case Kind::Number: case Kind::Integer: emit(Op::Const, constant(*p)); break;
+            case Kind::Quote:
+                if (p + 1 == e) { error("Quote expects 1 arg"); goto done; }
+                emit(Op::Const, constant(*++p));
+                break;
+            case Kind::Lambda:
+                if (p + 2 >= e) { error("Malformed lambda expression"); goto done; }
+                lambda(p[1], p[2]);
+                p += 2;
+                break;
+            case Kind::Begin: case Kind::Define: case Kind::Let: case Kind::Profile: case Kind::Future:
+                form(p, e, false);
+                ends.push_back(emit(Op::Jump));
+                goto done;
+            case Kind::Expr: sublist(p->list(), false); break;
+            case Kind::Cond: {
+                auto q = p;
+                while (++q != e) {
+                    if (q->kind != Kind::Expr) { error(bad_get); goto done; }
+                    const List& clause = q->list();
+                    if (clause.size() < 2) { error("Malformed clause in condition"); goto done; }
+                    if (clause[0].kind == Kind::Else) {
+                        if (q + 1 != e) { error("Else clause not at end of condition"); goto done; }
+                        form(clause.begin() + 1, clause.begin() + 2, false);
+                        break;
+                    }
+                    form(clause.begin(), clause.begin() + 1, false);
+                    int next = emit(Op::False);
+                    form(clause.begin() + 1, clause.begin() + 2, false);
+                    resume[q + 1 - b].push_back(emit(Op::Jump));
+                    patch(next);
+                }
+                ends.push_back(emit(Op::Jump));
+                if (p + 1 == e) goto done;
+                ++p;    // clauses after the first are evaluated as part of the list when resumed
+                break;
+            }
+            case Kind::Name: load(p->sym(), false); break;
+            default:
+                if (!is_prim(p->kind)) { error("Unmatched in evlist"); goto done; }
+                if (p + 1 == e && !Parser::nullary(p->kind)) { error("Primitives take at least one argument"); goto done; }
+                emit(Op::Prim, constant(*p));
+                break;
+        }
+    }
+done:   // anything resuming past an early return ends the list as well
+    for (; p <= e; ++p)
+        for (int at : resume[p - b]) patch(at);
+    for (int end : ends) patch(end);
+}
+
+shared_ptr<Code> Compiler::compile(const List& expr) {
+    auto code = make_shared<Code>();
+    Emitter{*code, {}}.form(expr.begin(), expr.end(), true);
+    code->instrs.push_back({Op::Return, 0, 0});
+    return code;
+}
+
+shared_ptr<Code> Compiler::compile(const List& params, const List& body) {
+    return procedure(params, body, {});
+}
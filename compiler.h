@@ -0,0 +1,14 @@
+#ifndef clispp_compiler
+#define clispp_compiler
+#include "bytecode.h"
+
+namespace Compiler {
+    using namespace Bytecode;
+
+    // compiles an expression given back by Parser::expr() (or a procedure body) into code returning its value,
+    // mirroring the semantics of Parser::eval and Parser::evlist
+    shared_ptr<Code> compile(const List& expr);
+    // procedure made outside of compiled code, names not among its parameters are looked up from its environment
+    shared_ptr<Code> compile(const List& params, const List& body);
+}
+#endif
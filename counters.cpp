@@ -0,0 +1,114 @@
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include "counters.h"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace Counters;
+
+const char* Counters::name(Event e) {
+    static const char* names[events] {"cycles", "instructions", "cache-misses", "branch-misses"};
+    return names[e];
+}
+
+Sample& Sample::operator+=(const Sample& s) {
+    for (int e = 0; e < events; ++e) {
+        value[e] += s.value[e];
+        counted[e] = counted[e] || s.counted[e];
+    }
+    return *this;
+}
+
+#ifdef __linux__
+namespace {
+    const unsigned long long configs[events] {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                              PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+    int open(unsigned long long config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;   // threads started while it is open, such as the pool of Parallel on its first use
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);  // this thread on any cpu
+    }
+}
+
+Group::Group() {
+    for (int e = 0; e < events; ++e) {
+        fd[e] = open(configs[e]);
+        if (fd[e] < 0 && why.empty()) why = string{name(Event(e))} + ": " + strerror(errno);
+    }
+}
+
+Group::~Group() {
+    for (int e = 0; e < events; ++e) if (fd[e] >= 0) close(fd[e]);
+}
+
+bool Group::available() const {
+    for (int e = 0; e < events; ++e) if (fd[e] >= 0) return true;
+    return false;
+}
+
+void Group::start() {
+    for (int e = 0; e < events; ++e) {
+        if (fd[e] < 0) continue;
+        ioctl(fd[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+Sample Group::stop() {
+    Sample s;
+    for (int e = 0; e < events; ++e) if (fd[e] >= 0) ioctl(fd[e], PERF_EVENT_IOC_DISABLE, 0);
+    for (int e = 0; e < events; ++e) {
+        unsigned long long read_values[3];  // value, time enabled, time running
+        if (fd[e] < 0 || read(fd[e], read_values, sizeof read_values) != sizeof read_values) continue;
+        s.counted[e] = true;
+        s.value[e] = read_values[2] == 0 || read_values[2] == read_values[1]? read_values[0]
+                   : static_cast<long long>(double(read_values[0]) * read_values[1] / read_values[2]);
+    }
+    return s;
+}
+#else
+Group::Group() : why {"hardware counters are only read on Linux"} {
+    for (int e = 0; e < events; ++e) fd[e] = -1;
+}
+
+Group::~Group() {}
+
+bool Group::available() const { return false; }
+
+void Group::start() {}
+
+Sample Group::stop() { return Sample{}; }
+#endif
+
+void Counters::print(ostream& os, const Sample& s, size_t n) {
+    if (n == 0) n = 1;
+    ios::fmtflags flags {os.flags()};
+    streamsize precision {os.precision()};
+    os << fixed;
+    const char* gap {""};
+    for (int e = 0; e < events; ++e) {
+        if (!s.counted[e]) continue;
+        os.precision(n == 1? 0 : 1);
+        os << gap << name(Event(e)) << ' ' << double(s.value[e]) / n;
+        gap = "  ";
+    }
+    os.precision(2);
+    if (s.ipc()) os << gap << "ipc " << s.ipc();
+    os.flags(flags);
+    os.precision(precision);
+}
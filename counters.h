@@ -0,0 +1,44 @@
+#ifndef clispp_counters
+#define clispp_counters
+#include <iosfwd>
+#include <string>
+
+// hardware performance counters of the calling thread through Linux perf_event_open, for -counters in clisp
+// and clisp-bench. only user space is counted, which the default perf_event_paranoid allows; any counter the
+// kernel or the machine refuses is left out, and with none at all the group is simply not available.
+// threads the calling one starts while a group is open are counted with it, but not ones already running:
+// the thread pool of pmap, preduce and future lives as long as the process, so a group opened after its
+// first use leaves the work done on the pool out, as for later benchmarks of a clisp-bench run
+namespace Counters {
+    using namespace std;
+
+    enum Event { Cycles, Instructions, Cache_misses, Branch_misses, events };
+    const char* name(Event e);
+
+    struct Sample {
+        long long value[events] {};
+        bool counted[events] {};    // false for counters that could not be opened
+        double ipc() const { return counted[Cycles] && counted[Instructions] && value[Cycles]? double(value[Instructions]) / value[Cycles] : 0; }
+        Sample& operator+=(const Sample& s);
+    };
+
+    class Group {
+    public:
+        Group();    // opens every counter it can
+        ~Group();
+        Group(const Group&) = delete;
+        Group& operator=(const Group&) = delete;
+
+        bool available() const;
+        const string& reason() const { return why; }    // the kernel's refusal when not available
+        void start();   // counting from zero
+        Sample stop();  // scaled up for the time the kernel multiplexed a counter out
+    private:
+        int fd[events];
+        string why;
+    };
+
+    // one line of the counts, divided by n such as repetitions or expressions evaluated
+    void print(ostream& os, const Sample& s, size_t n = 1);
+}
+#endif
@@ -11,38 +11,77 @@ namespace Environment {
     using Lexer::Cell;
     using Lexer::Proc;
     using Lexer::List;
+    using Lexer::Symbol;
 
-    class Env {
+    class Env : Alloc::Tally<Alloc::Envs> {
     private:
-        using Env_map = unordered_map<string, Cell>;
-        Env_map env;
+        using Env_map = unordered_map<const Symbol*, Cell>;    // keyed by interned symbols
+        Env_map env;            // bound by name, global environment and frames made by Parser::bind
+        vector<Cell> slots;     // frames made by the VM, names resolved to slots at compile time
         Env* outer;
+        bool sealed {false};    // stands for the global environment, see seal
     public:
         // constructors
         Env() : outer{nullptr} {}
         Env(Env* o) : outer{o} {}
-        Env(const List& params, const List& args, Env* o) : outer{o} {
-            auto a = args.begin();
-            for (auto p = params.begin(); p != params.end(); ++p, ++a)
-                env[boost::get<string>(p->data)] = *a++;    
-        }
+        Env(size_t n, Env* o) : slots(n, Cell{Lexer::Kind::Undefined}), outer{o} { Alloc::bytes(Alloc::Envs, n * sizeof(Cell)); }
 
-        Env_map& findframe(string n) {
-            if (env.find(n) != env.end())
-                return env;
-            else if (outer != nullptr) 
-                return outer->findframe(n);
-            throw runtime_error("Unbound variable");
+        Cell* find(const Symbol* n) {   // nullptr if unbound
+            for (Env* e {this}; e != nullptr; e = e->outer) {
+                auto b = e->env.find(n);
+                if (b != e->env.end()) return &b->second;
+            }
+            return nullptr;
         }
 
-        Cell& lookup(string n) {
-            return findframe(n)[n];
+        Cell& lookup(const Symbol* n) {
+            Cell* c {find(n)};
+            if (c == nullptr) throw runtime_error("Unbound variable");
+            return *c;
         }
 
-        Cell& operator[](string n) { // access for assignment
+        Cell& operator[](const Symbol* n) { // access for assignment
             return env[n];
         }
 
+        Cell& slot(size_t i) { return slots[i]; }
+        size_t slot_count() const { return slots.size(); }
+
+        void reset(size_t n, Env* o) {  // a new frame of n slots, keeping the storage of this one
+            if (!env.empty()) env.clear();
+            if (n > slots.capacity()) Alloc::bytes(Alloc::Envs, n * sizeof(Cell));
+            slots.assign(n, Cell{Lexer::Kind::Undefined});
+            outer = o;
+            sealed = false;
+        }
+
+        template <typename F>
+        void each(F f) {    // every bound cell
+            for (auto& b : env) f(b.second);
+            for (auto& c : slots) f(c);
+        }
+
+        template <typename F>
+        void bindings(F f) const {  // every cell bound by name, with the name
+            for (auto& b : env) f(b.first, b.second);
+        }
+
+        size_t bytes() const {  // owned heap memory, roughly
+            return env.size() * (sizeof(Env_map::value_type) + 2 * sizeof(void*)) + env.bucket_count() * sizeof(void*)
+                + slots.capacity() * sizeof(Cell);
+        }
+
+        Env* parent() { return outer; }
+        // the global environment, or one standing for it whose bindings are all made before anything is looked up
+        // from it: bindings found from either can't be shadowed later, so they may be cached
+        bool outermost() const { return outer == nullptr || sealed; }
+        void seal() { sealed = true; }
+        Env* up(int depth) {    // enclosing frame depth levels out
+            Env* e {this};
+            while (depth--) e = e->outer;
+            return e;
+        }
+
         // copying and moving
         Env(const Env&) = default;
         Env& operator=(const Env&) = default;
@@ -51,10 +90,5 @@ namespace Environment {
         Env& operator=(Env&&) = default;
         ~Env() = default;
     };
-
-    extern Env e0;
-    constexpr int max_capacity = 10000; // max of 10000 variables and procedures
-    extern vector<Env> envs; 
-    extern vector<Proc> procs;
 }
 #endif
@@ -8,4 +8,13 @@ namespace Lexer {
 namespace Environment {
     class Env;
 }
+namespace Bytecode {
+    struct Code;
+}
+namespace JIT {
+    struct Native;
+}
+namespace Parallel {
+    struct Task;
+}
 #endif
@@ -23,10 +23,6 @@
 		(else (reduce f (f start (car seq)) 
 						(cdr seq)))))
 
-(define (modulo n r)
-		(cond ((< n r) n)
-			  (else (modulo (- n r) r))))
-
 ; primitive wrappers for passing into functions
 (define (add x y) (+ x y))
 (define (sub x y) (- x y))
@@ -0,0 +1,191 @@
+#include <chrono>
+#include "gc.h"
+#include "vm.h"
+#include "interpreter.h"
+#include "trace.h"
+#include "error.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace Environment;
+
+namespace {
+    constexpr size_t min_threshold {1024};
+
+    size_t owned(const Env& e) { return e.bytes(); }
+    size_t owned(const Proc&) { return 0; }    // params and body are shared with the program
+
+    void mark(GC::Heap& h, Proc* p) {
+        size_t i {h.procs.index(p)};
+        if (h.proc_marks[i]) return;
+        h.proc_marks[i] = true;
+        h.gray_procs.push_back(p);
+    }
+
+    void mark(GC::Heap& h, Env* e) {
+        if (e == nullptr) return;
+        size_t i {h.envs.index(e)};
+        if (i < h.envs.size()) {
+            if (h.env_marks[i]) return;
+            h.env_marks[i] = true;
+        }
+        else if (!h.outside.insert(e).second) return;
+        h.gray_envs.push_back(e);
+    }
+
+    void mark(GC::Heap& h, const Cell& c) {
+        if (c.kind == Kind::Proc) mark(h, c.proc());
+        else if (c.kind == Kind::Expr) {    // shared tails are walked once per collection
+            const Seq* s {c.seq()};
+            if (s == nullptr || s->seen == h.stats.collections + 1) return;
+            s->seen = h.stats.collections + 1;
+            h.gray_lists.push_back(s);
+        }
+    }
+
+    void scan(GC::Heap& h, const Seq* s) {  // elements of a gray list node, leaving the lists among them gray
+        ++h.traced;
+        if (s->form == Seq::Form::Run) { for (auto& x : s->items) mark(h, x); return; }
+        if (s->form == Seq::Form::Pair) mark(h, s->head);
+        mark(h, s->rest);   // the rest of a pair, or the run a tail is part of
+    }
+
+    Alloc::Type type(const Env*) { return Alloc::Envs; }
+    Alloc::Type type(const Proc*) { return Alloc::Procs; }
+
+    // filled in place by init, reusing the storage of a freed slot rather than moving a temporary into it
+    template <typename T, typename F>
+    T* allocate(GC::Heap& h, GC::Pool<T>& pool, vector<size_t>& free, vector<bool>& is_free, F init) {
+        if (h.live >= h.threshold) GC::collect();
+        ++h.live;
+        ++h.stats.allocated;
+        if (!free.empty()) {
+            size_t i {free.back()};
+            free.pop_back();
+            is_free[i] = false;
+            init(pool[i]);
+            return &pool[i];
+        }
+        is_free.push_back(false);
+        if (pool.size() == pool.capacity()) Alloc::bytes(type(static_cast<const T*>(nullptr)), GC::Pool<T>::chunk * sizeof(T));
+        T* x {pool.add()};
+        init(*x);
+        return x;
+    }
+
+    template <typename T>
+    size_t sweep(GC::Pool<T>& pool, vector<bool>& marks, vector<size_t>& free, vector<bool>& is_free, size_t& freed) {
+        size_t bytes {0};
+        for (size_t i = 0; i < pool.size(); ++i) {
+            if (marks[i] || is_free[i]) continue;
+            bytes += sizeof(T) + owned(pool[i]);
+            pool[i] = T{};
+            is_free[i] = true;
+            free.push_back(i);
+            ++freed;
+        }
+        return bytes;
+    }
+}
+
+vector<GC::Held>& GC::roots() {
+    return Interpreter::current().heap.roots;
+}
+
+GC::Hold::Hold() : heap(Interpreter::current().heap), threshold{heap.threshold} { heap.threshold = SIZE_MAX; }
+GC::Hold::~Hold() { heap.threshold = threshold; }
+
+void GC::mark(Env* e) {
+    ::mark(Interpreter::current().heap, e);
+}
+
+void GC::mark(const Cell& c) {
+    ::mark(Interpreter::current().heap, c);
+}
+
+void GC::collect() {
+    auto start = chrono::steady_clock::now();
+    Interpreter& in_use = Interpreter::current();
+    Heap& h = in_use.heap;
+    h.env_marks.assign(h.envs.size(), false);
+    h.proc_marks.assign(h.procs.size(), false);
+    h.env_free.resize(h.envs.size(), false);
+    h.proc_free.resize(h.procs.size(), false);
+    h.outside.clear();
+    h.traced = 0;
+
+    ::mark(h, &in_use.e0);
+    for (auto& r : h.roots) {
+        if (r.cell) ::mark(h, *r.cell);
+        else if (r.list) for (auto& c : *r.list) ::mark(h, c);
+        else ::mark(h, r.env);
+    }
+    VM::mark();
+    while (!h.gray_envs.empty() || !h.gray_procs.empty() || !h.gray_lists.empty()) {
+        if (!h.gray_lists.empty()) {
+            const Seq* s {h.gray_lists.back()};
+            h.gray_lists.pop_back();
+            scan(h, s);
+        }
+        else if (!h.gray_envs.empty()) {
+            Env* e {h.gray_envs.back()};
+            h.gray_envs.pop_back();
+            ::mark(h, e->parent());
+            e->each([&h](const Cell& c) { ::mark(h, c); });
+        }
+        else {
+            Proc* p {h.gray_procs.back()};
+            h.gray_procs.pop_back();
+            ::mark(h, p->env);
+        }
+    }
+
+    size_t bytes {sweep(h.envs, h.env_marks, h.free_envs, h.env_free, h.stats.envs_freed)};
+    bytes += sweep(h.procs, h.proc_marks, h.free_procs, h.proc_free, h.stats.procs_freed);
+    h.live = h.envs.size() - h.free_envs.size() + h.procs.size() - h.free_procs.size();
+    h.threshold = max(min_threshold, (h.live + h.traced) * 2);
+
+    chrono::duration<double> pause = chrono::steady_clock::now() - start;
+    ++h.stats.collections;
+    h.stats.bytes_freed += bytes;
+    h.stats.pause_total += pause.count();
+    h.stats.pause_max = max(h.stats.pause_max, pause.count());
+}
+
+Env* GC::env(Env* outer) {
+    Heap& h = Interpreter::current().heap;
+    Env* e {allocate(h, h.envs, h.free_envs, h.env_free, [outer](Env& e) { e.reset(0, outer); })};
+    if (Trace::enabled) Trace::env(e, outer, 0);
+    return e;
+}
+
+Env* GC::env(size_t slots, Env* outer) {
+    Heap& h = Interpreter::current().heap;
+    Env* e {allocate(h, h.envs, h.free_envs, h.env_free, [slots, outer](Env& e) { e.reset(slots, outer); })};
+    if (Trace::enabled) Trace::env(e, outer, slots);
+    return e;
+}
+
+Proc* GC::proc(const Cell& params, const Cell& body, Env* env, shared_ptr<Bytecode::Code> code) {
+    Heap& h = Interpreter::current().heap;
+    Alloc::made(Alloc::Procs);
+    return allocate(h, h.procs, h.free_procs, h.proc_free, [&](Proc& p) {
+        p.params = params;
+        p.body = body;
+        p.env = env;
+        p.code = move(code);
+        p.calls = 0;
+        p.native = nullptr;
+    });
+}
+
+Cell GC::report() {
+    const Heap& h = Interpreter::current().heap;
+    auto count = [](size_t n) { return Cell{static_cast<long long>(n)}; };
+    return List{List{"collections", count(h.stats.collections)},
+        List{"envs-freed", count(h.stats.envs_freed)}, List{"procs-freed", count(h.stats.procs_freed)},
+        List{"bytes-freed", count(h.stats.bytes_freed)},
+        List{"pause-total-ms", h.stats.pause_total * 1000}, List{"pause-max-ms", h.stats.pause_max * 1000},
+        List{"envs-live", count(h.envs.size() - h.free_envs.size())}, List{"procs-live", count(h.procs.size() - h.free_procs.size())},
+        List{"envs-capacity", count(h.envs.capacity())}, List{"procs-capacity", count(h.procs.capacity())}};
+}
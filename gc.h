@@ -0,0 +1,124 @@
+#ifndef clispp_gc
+#define clispp_gc
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <unordered_set>
+#include "environment.h"
+
+namespace GC {
+    using namespace std;
+    using Lexer::Cell;
+    using Lexer::List;
+    using Lexer::Proc;
+    using Environment::Env;
+
+    struct Stats {
+        size_t collections {0};
+        size_t envs_freed {0};
+        size_t procs_freed {0};
+        size_t allocated {0};   // environments and procedures
+        size_t bytes_freed {0};
+        double pause_total {0}; // seconds
+        double pause_max {0};
+    };
+
+    struct Held {
+        const Cell* cell;
+        const List* list;
+        Env* env;
+    };
+
+    template <typename T>
+    class Pool {    // grows a chunk at a time, elements never move so cells can point at them
+    public:
+        static constexpr size_t chunk {256};
+
+        size_t size() const { return count; }   // elements handed out, live or free
+        size_t capacity() const { return chunks.size() * chunk; }
+        T& operator[](size_t i) { return chunks[i / chunk][i % chunk]; }
+
+        T* add() {  // the next element, value initialized the first time it is handed out
+            if (count == capacity()) grow();
+            return &(*this)[count++];
+        }
+
+        size_t index(const T* p) const {    // of an element, size() if p is not one
+            uintptr_t a {reinterpret_cast<uintptr_t>(p)};
+            auto c = upper_bound(starts.begin(), starts.end(), a, [](uintptr_t a, const pair<uintptr_t, size_t>& s) { return a < s.first; });
+            if (c == starts.begin() || a - (--c)->first >= chunk * sizeof(T)) return count;
+            size_t i {c->second * chunk + (a - c->first) / sizeof(T)};
+            return i < count? i : count;
+        }
+    private:
+        vector<unique_ptr<T[]>> chunks;
+        vector<pair<uintptr_t, size_t>> starts;     // address of each chunk with its number, by address
+
+        void grow() {
+            chunks.emplace_back(new T[chunk]());
+            pair<uintptr_t, size_t> s {reinterpret_cast<uintptr_t>(chunks.back().get()), chunks.size() - 1};
+            starts.insert(upper_bound(starts.begin(), starts.end(), s), s);
+        }
+        size_t count {0};
+    };
+
+    struct Heap {   // environments and procedures of one interpreter, slots of unreachable ones are reused
+        Pool<Env> envs;
+        Pool<Proc> procs;
+        Stats stats;
+        vector<Held> roots;
+
+        // collector state
+        vector<bool> env_marks, proc_marks;
+        vector<bool> env_free, proc_free;
+        vector<size_t> free_envs, free_procs;   // indices of reusable slots
+        vector<Env*> gray_envs;
+        vector<Proc*> gray_procs;
+        vector<const Lexer::Seq*> gray_lists;   // so marking never recurses as deep as lists nest
+        unordered_set<Env*> outside;    // environments not in envs, e0 and let frames of Parser::eval
+        size_t live {0};        // envs and procs in use
+        size_t threshold {1024};    // collect once live reaches this
+        size_t traced {0};      // list nodes marked in the current collection, they make it longer without counting as live
+    };
+
+    // the functions below work on the heap of the interpreter in use on this thread.
+    // allocating may collect, so anything only held by C++ code has to be kept by a Root first
+    Env* env(Env* outer);
+    Env* env(size_t slots, Env* outer);
+    Proc* proc(const Cell& params, const Cell& body, Env* env, shared_ptr<Bytecode::Code> code = nullptr);
+
+    void collect();     // mark from e0, roots and the VM, then sweep
+    Cell report();      // (gc-stats)
+
+    // used by the VM to report its stack and frames during collection
+    void mark(const Cell& c);
+    void mark(Env* e);
+
+    vector<Held>& roots();
+
+    class Root {    // keeps a cell, list or environment held on the C++ stack alive for its scope
+    public:
+        Root(const Cell& c) : held(roots()), at{held.size()} { held.push_back({&c, nullptr, nullptr}); }
+        Root(const List& l) : held(roots()), at{held.size()} { held.push_back({nullptr, &l, nullptr}); }
+        Root(Env* e) : held(roots()), at{held.size()} { held.push_back({nullptr, nullptr, e}); }
+        ~Root() { held.pop_back(); }
+        void reset(Env* e) { held[at].env = e; }    // keep another environment instead
+        Root(const Root&) = delete;
+        Root& operator=(const Root&) = delete;
+    private:
+        vector<Held>& held;
+        size_t at;
+    };
+
+    class Hold {    // no collection for its scope, while objects are made that only become reachable at its end
+    public:
+        Hold();
+        ~Hold();
+        Hold(const Hold&) = delete;
+        Hold& operator=(const Hold&) = delete;
+    private:
+        Heap& heap;
+        size_t threshold;
+    };
+}
+#endif
@@ -0,0 +1,35 @@
+#include "interpreter.h"
+#include "parser.h"
+#include "error.h"
+
+using namespace std;
+using namespace Lexer;
+
+namespace {
+    thread_local Interpreter* active {nullptr};
+}
+
+Interpreter::Interpreter(istream& in, ostream& out) : cs{in, symbols}, outstream{&out} {}
+
+Interpreter& Interpreter::current() {
+    if (active == nullptr) throw runtime_error("No interpreter in use on this thread");
+    return *active;
+}
+
+Interpreter::Use::Use(Interpreter& in) : previous{active} { active = &in; }
+Interpreter::Use::~Use() { active = previous; }
+
+List Interpreter::expr(bool getfirst) {
+    Use use {*this};
+    return Parser::expr(getfirst);
+}
+
+Cell Interpreter::eval(const List& expr) {
+    Use use {*this};
+    return reference? Parser::eval(expr, &e0) : VM::eval(expr, &e0);
+}
+
+Cell Interpreter::apply(const Cell& proc, const List& args) {
+    Use use {*this};
+    return reference? Parser::apply(proc, args) : VM::apply(proc, args);
+}
@@ -0,0 +1,55 @@
+#ifndef clispp_interpreter
+#define clispp_interpreter
+#include "lexer.h"
+#include "environment.h"
+#include "gc.h"
+#include "vm.h"
+#include "jit.h"
+#include "profile.h"
+
+// everything one interpreter works on, so a process can run several of them, one per thread at a time.
+// the functions of Lexer, Parser, VM and GC act on the interpreter in use on the calling thread,
+// made current by the members below or explicitly by a Use.
+// cells are reference counted without atomics, so values must not be shared between interpreters
+class Interpreter {
+public:
+    using Cell = Lexer::Cell;
+    using List = Lexer::List;
+    using Env = Environment::Env;
+
+    explicit Interpreter(std::istream& in = std::cin, std::ostream& out = std::cout);
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+
+    List expr(bool getfirst = true);    // next unevaluated expression from input
+    Cell eval(const List& expr);        // in the global environment
+    Cell apply(const Cell& proc, const List& args);
+
+    static Interpreter& current();      // throws if none is in use on this thread
+
+    class Use {     // makes an interpreter current on this thread for its scope
+    public:
+        explicit Use(Interpreter& in);
+        ~Use();
+        Use(const Use&) = delete;
+        Use& operator=(const Use&) = delete;
+    private:
+        Interpreter* previous;
+    };
+
+    Lexer::Symbol_table symbols;    // first, to outlast every cell of the interpreter
+    Lexer::Cell_stream cs;
+    List parsing;   // elements of the lists Parser::expr has open, reused between expressions
+    std::ostream* outstream;
+    bool reference {false};     // evaluate with the tree walking Parser::eval instead of the VM
+    bool jit {JIT::supported()};    // let the VM run hot procedures as machine code
+    size_t max_depth {1000000}; // nested calls allowed before giving up, calls in tail position don't nest
+    size_t depth {0};           // evaluations of Parser::eval nested on the native stack
+    const char* base {nullptr}; // where the outermost one started
+    Env e0;
+    GC::Heap heap;
+    VM::Machine vm;
+    JIT::Region natives;
+    Profile::Profiler profiler;
+};
+#endif
@@ -0,0 +1,450 @@
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "jit.h"
+#include "environment.h"
+#include "interpreter.h"
+#include "error.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace JIT;
+
+JIT::Region::~Region() {
+    for (auto& m : maps) munmap(m.first, m.second);
+}
+
+void* JIT::Region::add(const vector<unsigned char>& code) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size {(code.size() + page - 1) / page * page};
+    void* m {mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+    if (m == MAP_FAILED) return nullptr;
+    memcpy(m, code.data(), code.size());
+    if (mprotect(m, size, PROT_READ | PROT_EXEC) != 0) { munmap(m, size); return nullptr; }   // never writable and executable at once
+    maps.push_back({m, size});
+    return m;
+}
+
+const Native* JIT::Region::keep(const Native& n) {
+    natives.emplace_back(new Native(n));
+    return natives.back().get();
+}
+
+namespace {
+    const Variant none {nullptr, false, 0};
+}
+
+#if defined(__x86_64__)
+namespace {
+    using Iter = List::const_iterator;
+    constexpr long native_stack {512 << 10};    // bytes the nested calls of one entry may take
+
+    enum class Type { Integer, Double, None };  // of a value, in rax or xmm0, None after a call in tail position
+
+    struct Label {
+        int at {-1};
+        vector<int> uses;   // rel32 fields waiting for at
+    };
+
+    class Assembler {   // the few instructions the templates are made of
+    public:
+        vector<unsigned char> code;
+
+        void bytes(initializer_list<int> bs) { for (int b : bs) code.push_back(b); }
+        void imm32(int32_t v) { for (int i = 0; i < 4; ++i) code.push_back(v >> 8 * i & 0xff); }
+        void imm64(uint64_t v) { for (int i = 0; i < 8; ++i) code.push_back(v >> 8 * i & 0xff); }
+
+        void bind(Label& l) {
+            l.at = code.size();
+            for (int u : l.uses) patch(u, l.at);
+        }
+        void jump(Label& l) { bytes({0xe9}); rel32(l); }
+        void call(Label& l) { bytes({0xe8}); rel32(l); }
+        void jcc(int cc, Label& l) { bytes({0x0f, 0x80 | cc}); rel32(l); }
+
+        void integer(long long n) { bytes({0x48, 0xb8}); imm64(n); }   // mov rax, n
+        void constant(double d) {
+            uint64_t bits;
+            memcpy(&bits, &d, 8);
+            integer(bits);
+            bytes({0x66, 0x48, 0x0f, 0x6e, 0xc0});          // movq xmm0, rax
+        }
+        void load(const double* at) {
+            integer(reinterpret_cast<uint64_t>(at));
+            bytes({0xf2, 0x0f, 0x10, 0x08});                // movsd xmm1, [rax]
+        }
+        void argument(Type t, int offset) {     // mov rax, [rbx + offset] or movsd xmm0, [rbx + offset]
+            if (t == Type::Integer) bytes({0x48, 0x8b, 0x83});
+            else bytes({0xf2, 0x0f, 0x10, 0x83});
+            imm32(offset);
+        }
+        void push(Type t) {
+            bytes({0x48, 0x83, 0xec, 0x10});                // sub rsp, 16
+            if (t == Type::Integer) bytes({0x48, 0x89, 0x04, 0x24});   // mov [rsp], rax
+            else bytes({0xf2, 0x0f, 0x11, 0x04, 0x24});     // movsd [rsp], xmm0
+        }
+        void integers() {   // pushed value to rax, rax to rcx
+            bytes({0x48, 0x89, 0xc1});                      // mov rcx, rax
+            bytes({0x48, 0x8b, 0x04, 0x24});                // mov rax, [rsp]
+            bytes({0x48, 0x83, 0xc4, 0x10});                // add rsp, 16
+        }
+        void doubles(Type left, Type right) {   // pushed value to xmm0, the one in rax or xmm0 to xmm1
+            if (right == Type::Integer) bytes({0xf2, 0x48, 0x0f, 0x2a, 0xc8});     // cvtsi2sd xmm1, rax
+            else bytes({0x66, 0x0f, 0x28, 0xc8});                                   // movapd xmm1, xmm0
+            if (left == Type::Integer) bytes({0xf2, 0x48, 0x0f, 0x2a, 0x04, 0x24}); // cvtsi2sd xmm0, [rsp]
+            else bytes({0xf2, 0x0f, 0x10, 0x04, 0x24});                             // movsd xmm0, [rsp]
+            bytes({0x48, 0x83, 0xc4, 0x10});
+        }
+        void arithmetic(Kind k, Type t) {   // rax op= rcx or xmm0 op= xmm1
+            if (t == Type::Integer) {
+                if (k == Kind::Mul) bytes({0x48, 0x0f, 0xaf, 0xc1});
+                else bytes({0x48, k == Kind::Add? 0x01 : 0x29, 0xc8});
+                return;
+            }
+            int op {k == Kind::Add? 0x58 : k == Kind::Mul? 0x59 : k == Kind::Sub? 0x5c : 0x5e};
+            bytes({0xf2, 0x0f, op, 0xc1});
+        }
+        void compare(bool swapped) {    // ucomisd xmm1, xmm0 or ucomisd xmm0, xmm1
+            bytes({0x66, 0x0f, 0x2e, swapped? 0xc1 : 0xc8});
+        }
+        void drop(int values) { bytes({0x48, 0x81, 0xc4}); imm32(16 * values); }   // add rsp, 16 * values
+        void copy(int offset) {     // pushed argument at offset over the one at the same offset from rbx
+            bytes({0x48, 0x8b, 0x84, 0x24}); imm32(offset);    // mov rax, [rsp + offset]
+            bytes({0x48, 0x89, 0x83}); imm32(offset);          // mov [rbx + offset], rax
+        }
+
+    private:
+        void rel32(Label& l) {
+            int at = code.size();
+            imm32(0);
+            if (l.at >= 0) patch(at, l.at);
+            else l.uses.push_back(at);
+        }
+        void patch(int at, int target) {
+            int32_t d {target - (at + 4)};
+            memcpy(&code[at], &d, 4);
+        }
+    };
+
+    enum Condition { overflow = 0x0, equal = 0x4, not_equal = 0x5, below_equal = 0x6, not_sign = 0x9, greater_equal = 0xd, less_equal = 0xe };
+
+    // a procedure body to machine code for arguments of one type, assuming the type of what it gives back,
+    // following what Compiler emits for the same forms so the values agree.
+    // arguments of a call are pushed 16 bytes apart, the last one lowest, and rbx points at those of the call running
+    class Translator {
+    public:
+        Translator(Proc& p, Type a, Type r) : proc(p), params(p.params.list()), args(a), result(r) {}
+        Variant compile(const Cell*& self);     // entry nullptr if the body can't be compiled this way
+    private:
+        Proc& proc;
+        const List& params;
+        Type args, result;
+        const Cell* self {nullptr};
+        Assembler a;
+        Label bail, body, top;
+        int pending {0}, deepest {0};   // values pushed while evaluating arguments
+
+        int param(const Cell& c) const {
+            if (c.kind != Kind::Name) return -1;
+            for (size_t i = 0; i < params.size(); ++i)
+                if (params[i].sym() == c.sym()) return i;
+            return -1;
+        }
+        int offset(int i) const { return 16 * (params.size() - 1 - i); }
+        bool is_self(const Cell& c);
+        static bool is_arithmetic(Kind k) {
+            return k == Kind::Add || k == Kind::Sub || k == Kind::Mul || k == Kind::Div || k == Kind::Modulo || k == Kind::Quotient;
+        }
+        static bool join(Type& t, Type u) {     // types of the branches of a cond
+            if (t == Type::None) t = u;
+            return u == Type::None || u == t;
+        }
+
+        void push(Type t) { a.push(t); deepest = max(deepest, ++pending); }
+
+        bool form(Iter b, Iter e, bool tail, Type& t);
+        bool sublist(const List& l, bool tail, Type& t);
+        bool item(const Cell& c, Type& t);
+        bool fold(Kind k, Iter b, Iter e, Type& t);
+        bool binary(Kind k, Type left, Type right, Type& t);
+        bool call(Iter b, Iter e, bool tail, Type& t);
+        bool test(const Cell& c, Label& otherwise);
+        bool cond(Iter p, Iter e, bool tail, Type& t);
+    };
+
+    bool Translator::is_self(const Cell& c) {   // names not among the parameters are global, see Compiler::procedure
+        if (c.kind != Kind::Name || param(c) >= 0 || !proc.env->outermost()) return false;
+        const Cell* x {proc.env->find(c.sym())};
+        if (x == nullptr || x->kind != Kind::Proc || x->proc() != &proc) return false;
+        self = x;
+        return true;
+    }
+
+    bool Translator::form(Iter b, Iter e, bool tail, Type& t) {
+        if (b == e) return false;
+        switch (b->kind) {
+            case Kind::Integer: a.integer(b->fixnum()); t = Type::Integer; return true;
+            case Kind::Number: a.constant(b->num()); t = Type::Double; return true;
+            case Kind::Expr: return sublist(b->list(), tail, t);
+            case Kind::Cond: return cond(b, e, tail, t);
+            case Kind::Name:    // a parameter's value, the rest of the form is skipped over
+                if (param(*b) >= 0) { a.argument(args, offset(param(*b))); t = args; return true; }
+                return is_self(*b) && call(b + 1, e, tail, t);
+            default: return is_arithmetic(b->kind) && b + 1 != e && fold(b->kind, b + 1, e, t);
+        }
+    }
+
+    bool Translator::sublist(const List& l, bool tail, Type& t) {
+        if (l.empty()) return false;
+        if (is_arithmetic(l[0].kind)) return l.size() > 1 && fold(l[0].kind, l.begin() + 1, l.end(), t);
+        if (is_self(l[0])) return call(l.begin() + 1, l.end(), tail, t);
+        return l.size() == 1 && item(l[0], t);
+    }
+
+    bool Translator::item(const Cell& c, Type& t) {
+        switch (c.kind) {
+            case Kind::Integer: a.integer(c.fixnum()); t = Type::Integer; return true;
+            case Kind::Number: a.constant(c.num()); t = Type::Double; return true;
+            case Kind::Expr: return sublist(c.list(), false, t);
+            case Kind::Name:
+                if (param(c) < 0) return false;
+                a.argument(args, offset(param(c)));
+                t = args;
+                return true;
+            default: return false;
+        }
+    }
+
+    bool Translator::fold(Kind k, Iter b, Iter e, Type& t) {   // (op x y ...), left to right
+        if ((k == Kind::Modulo || k == Kind::Quotient) && e - b != 2) return false;
+        if (!item(*b, t)) return false;
+        while (++b != e) {
+            push(t);
+            Type right;
+            if (!item(*b, right) || !binary(k, t, right, t)) return false;
+            --pending;
+        }
+        return true;
+    }
+
+    bool Translator::binary(Kind k, Type left, Type right, Type& t) {  // pushed left op right, as Parser::fold
+        bool exact {left == Type::Integer && right == Type::Integer};
+        if (k == Kind::Modulo || k == Kind::Quotient) {     // the VM's integer division, doubles left to it
+            if (!exact) return false;
+            a.integers();
+            a.bytes({0x48, 0x85, 0xc9});    // test rcx, rcx
+            a.jcc(equal, bail);             // division by zero, which the VM reports
+            Label minus_one, done;
+            a.bytes({0x48, 0x83, 0xf9, 0xff});  // cmp rcx, -1
+            a.jcc(equal, minus_one);
+            a.bytes({0x48, 0x99, 0x48, 0xf7, 0xf9});    // cqo, idiv rcx
+            if (k == Kind::Modulo) {    // remainder in rdx, moved to the sign of rcx
+                Label same;
+                a.bytes({0x48, 0x85, 0xd2});    // test rdx, rdx
+                a.jcc(equal, same);
+                a.bytes({0x48, 0x89, 0xd0, 0x48, 0x31, 0xc8});  // mov rax, rdx, xor rax, rcx
+                a.jcc(not_sign, same);
+                a.bytes({0x48, 0x01, 0xca});    // add rdx, rcx
+                a.bind(same);
+                a.bytes({0x48, 0x89, 0xd0});    // mov rax, rdx
+            }
+            a.jump(done);
+            a.bind(minus_one);  // idiv would trap on the smallest integer
+            if (k == Kind::Modulo) a.bytes({0x31, 0xc0});  // xor eax, eax
+            else {
+                a.bytes({0x48, 0xf7, 0xd8});    // neg rax
+                a.jcc(overflow, bail);
+            }
+            a.bind(done);
+            t = Type::Integer;
+            return true;
+        }
+        if (exact) {
+            if (k == Kind::Div) return false;   // an integer only if it divides, known at run time
+            a.integers();
+            a.arithmetic(k, Type::Integer);
+            a.jcc(overflow, bail);  // the VM goes on in doubles
+            t = Type::Integer;
+            return true;
+        }
+        a.doubles(left, right);
+        a.arithmetic(k, Type::Double);
+        t = Type::Double;
+        return true;
+    }
+
+    bool Translator::call(Iter b, Iter e, bool tail, Type& t) {
+        int n = e - b;
+        if (size_t(n) != params.size()) return false;   // the VM would fail on it
+        for (auto p = b; p != e; ++p) {
+            Type arg;
+            if (!item(*p, arg) || arg != args) return false;    // the other variant would run it
+            push(arg);
+        }
+        pending -= n;
+        if (tail) {     // a loop, as the VM reuses the frame
+            for (int i = 0; i < n; ++i) a.copy(offset(i));
+            a.drop(n);
+            a.jump(top);
+            t = Type::None;
+            return true;
+        }
+        deepest = max(deepest, pending + n + 1);    // with the return address and rbx
+        a.bytes({0x53});                            // push rbx
+        a.bytes({0x48, 0x8d, 0x5c, 0x24, 0x08});    // lea rbx, [rsp + 8]
+        a.call(body);
+        a.bytes({0x5b});                            // pop rbx
+        a.drop(n);
+        t = result;
+        return true;
+    }
+
+    bool Translator::test(const Cell& c, Label& otherwise) {   // ((< x y) ...), jumping to otherwise if false
+        if (c.kind != Kind::Expr) return false;
+        const List& l = c.list();
+        if (l.size() != 3 || (l[0].kind != Kind::Less && l[0].kind != Kind::Greater && l[0].kind != Kind::Equal)) return false;
+        Type left, right;
+        if (!item(l[1], left)) return false;
+        push(left);
+        if (!item(l[2], right)) return false;
+        --pending;
+        if (left == Type::Integer && right == Type::Integer) {  // exactly
+            a.integers();
+            a.bytes({0x48, 0x39, 0xc8});    // cmp rax, rcx
+            a.jcc(l[0].kind == Kind::Less? greater_equal : l[0].kind == Kind::Greater? less_equal : not_equal, otherwise);
+            return true;
+        }
+        a.doubles(left, right);
+        if (l[0].kind != Kind::Equal) {
+            a.compare(l[0].kind == Kind::Greater);  // x < y is y > x
+            a.jcc(below_equal, otherwise);  // not above, or unordered
+            return true;
+        }
+        Label apart, done;      // as operator==, within equal_threshold
+        a.compare(false);
+        a.jcc(below_equal, apart);
+        a.bytes({0xf2, 0x0f, 0x5c, 0xc8});  // subsd xmm1, xmm0
+        a.bytes({0x66, 0x0f, 0x28, 0xc1});  // movapd xmm0, xmm1
+        a.jump(done);
+        a.bind(apart);
+        a.bytes({0xf2, 0x0f, 0x5c, 0xc1});  // subsd xmm0, xmm1
+        a.bind(done);
+        a.load(&equal_threshold);
+        a.compare(false);
+        a.jcc(below_equal, otherwise);
+        return true;
+    }
+
+    bool Translator::cond(Iter p, Iter e, bool tail, Type& t) {
+        Label end;
+        t = Type::None;
+        while (++p != e) {
+            if (p->kind != Kind::Expr) return false;
+            const List& clause = p->list();
+            if (clause.size() < 2) return false;
+            Type branch;
+            if (clause[0].kind == Kind::Else) {
+                if (p + 1 != e || !form(clause.begin() + 1, clause.begin() + 2, tail, branch) || !join(t, branch)) return false;
+                a.bind(end);
+                return true;
+            }
+            Label next;
+            if (!test(clause[0], next) || !form(clause.begin() + 1, clause.end(), tail, branch) || !join(t, branch)) return false;
+            a.jump(end);
+            a.bind(next);
+        }
+        a.jump(bail);   // no matching clause, which the VM reports
+        a.bind(end);
+        return true;
+    }
+
+    Variant Translator::compile(const Cell*& found) {
+        if (params.size() > max_args) return none;
+        for (auto& p : params) if (p.kind != Kind::Name) return none;
+        const List& b = proc.body.list();
+        // entry(args rdi, result rsi, depth rdx), callee saved registers hold the arguments, depth left
+        // and the stack pointer to give up from
+        a.bytes({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56});   // push rbx, r12, r13, r14
+        a.bytes({0x49, 0x89, 0xf6});    // mov r14, rsi
+        a.bytes({0x49, 0x89, 0xd4});    // mov r12, rdx
+        a.bytes({0x49, 0x89, 0xe5});    // mov r13, rsp
+        a.bytes({0x48, 0x89, 0xfb});    // mov rbx, rdi
+        a.call(body);
+        if (result == Type::Integer) a.bytes({0x49, 0x89, 0x06});  // mov [r14], rax
+        else a.bytes({0xf2, 0x41, 0x0f, 0x11, 0x06});   // movsd [r14], xmm0
+        a.bytes({0xb8}); a.imm32(1);    // mov eax, 1
+        Label leave;
+        a.bind(leave);
+        a.bytes({0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3});   // pop r14, r13, r12, rbx, ret
+        a.bind(bail);
+        a.bytes({0x4c, 0x89, 0xec});    // mov rsp, r13
+        a.bytes({0x31, 0xc0});          // xor eax, eax
+        a.jump(leave);
+        a.bind(body);
+        a.bytes({0x49, 0xff, 0xcc});    // dec r12
+        a.jcc(0x8, bail);               // js
+        a.bind(top);
+        Type t;
+        if (!form(b.begin(), b.end(), true, t) || !join(t, result)) return none;
+        a.bytes({0x49, 0xff, 0xc4, 0xc3});  // inc r12, ret
+        void* code {Interpreter::current().natives.add(a.code)};
+        if (code == nullptr) return none;
+        if (self) found = self;
+        return {reinterpret_cast<int (*)(const void*, void*, long)>(code), result == Type::Integer, native_stack / (16 * (deepest + 1))};
+    }
+
+    Variant variant(Proc& proc, Type args, const Cell*& self) {     // giving back the type of the arguments if it can
+        Type other {args == Type::Integer? Type::Double : Type::Integer};
+        for (Type result : {args, other}) {
+            Variant v {Translator{proc, args, result}.compile(self)};
+            if (v.entry) return v;
+        }
+        return none;
+    }
+
+    const Native* compile(Proc& proc) {
+        Native n {none, none, proc.params.list().size(), nullptr};
+        n.integers = variant(proc, Type::Integer, n.self);
+        n.doubles = variant(proc, Type::Double, n.self);
+        if (!n.integers.entry && !n.doubles.entry) return nullptr;
+        return Interpreter::current().natives.keep(n);
+    }
+}
+
+bool JIT::supported() { return true; }
+#else
+namespace {
+    const Native* compile(Proc&) { return nullptr; }
+}
+
+bool JIT::supported() { return false; }
+#endif
+
+bool JIT::call(Proc& proc, const Cell* args, const Cell* end, size_t depth, Cell& res) {
+    if (proc.native == nullptr) {
+        if (proc.calls != hot) return false;    // tried once, when it becomes hot
+        proc.native = compile(proc);
+        if (proc.native == nullptr) return false;
+    }
+    const Native& n = *proc.native;
+    size_t count = end - args;
+    if (count != n.arity || depth == 0) return false;
+    if (n.self && (n.self->kind != Kind::Proc || n.self->proc() != &proc)) return false;   // redefined
+    Kind kind {count? args[0].kind : Kind::Integer};
+    const Variant& v = kind == Kind::Integer? n.integers : n.doubles;
+    if (v.entry == nullptr || (count && !args[0].numeric())) return false;
+    uint64_t in[2 * max_args];
+    for (size_t i = 0; i < count; ++i) {
+        if (args[i].kind != kind) return false;
+        if (kind == Kind::Integer) { long long x {args[i].fixnum()}; memcpy(&in[2 * (count - 1 - i)], &x, 8); }
+        else { double x {args[i].num()}; memcpy(&in[2 * (count - 1 - i)], &x, 8); }
+    }
+    uint64_t out;
+    if (!v.entry(in, &out, min<size_t>(depth, v.depth))) {
+        proc.native = nullptr;  // too deep, overflowed or unmatched, left to the VM from now on
+        return false;
+    }
+    if (v.exact) { long long x; memcpy(&x, &out, 8); res = Cell{x}; }
+    else { double x; memcpy(&x, &out, 8); res = Cell{x}; }
+    return true;
+}
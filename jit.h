@@ -0,0 +1,52 @@
+#ifndef clispp_jit
+#define clispp_jit
+#include <memory>
+#include <vector>
+#include "lexer.h"
+
+// baseline compiler of hot procedures to x86-64 machine code, one template of instructions per form.
+// only bodies made of numbers, parameters, arithmetic, comparisons tested by cond and calls of the procedure
+// to itself are compiled, as they can neither allocate nor fail; anything else stays with the VM.
+// each body is compiled for integer arguments and for double arguments, where the type of every value is
+// then known. the VM checks the arguments before entering native code, which gives the call back to the VM
+// if it nests too deep, an integer overflows or divides by zero, or no clause of a cond matches
+namespace JIT {
+    using namespace std;
+    using Lexer::Cell;
+    using Lexer::Proc;
+
+    constexpr size_t hot {1000};    // calls made by the VM before a procedure is compiled
+    constexpr size_t max_args {16};
+
+    struct Variant {    // machine code for arguments all of one kind
+        int (*entry)(const void* args, void* result, long depth);  // 0 if it gave up, nullptr if not compiled
+        bool exact;     // gives an integer
+        long depth;     // nested calls the native stack allows
+    };
+
+    struct Native {     // machine code of one procedure
+        Variant integers, doubles;
+        size_t arity;
+        const Cell* self;   // global binding the procedure calls itself through, nullptr if it doesn't
+    };
+
+    class Region {  // executable memory of one interpreter, kept until the interpreter is destroyed
+    public:
+        Region() = default;
+        ~Region();
+        Region(const Region&) = delete;
+        Region& operator=(const Region&) = delete;
+
+        void* add(const vector<unsigned char>& code);  // into pages of its own, nullptr if none can be had
+        const Native* keep(const Native& n);
+    private:
+        vector<pair<void*, size_t>> maps;
+        vector<unique_ptr<Native>> natives;
+    };
+
+    bool supported();   // built for x86-64
+    // makes a call of the VM natively, compiling proc when it has just become hot.
+    // false if the VM has to make the call itself, depth being the nested calls it still allows
+    bool call(Proc& proc, const Cell* args, const Cell* end, size_t depth, Cell& res);
+}
+#endif
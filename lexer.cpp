@@ -1,27 +1,183 @@
-#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "lexer.h"
+#include "scan.h"
+#include "interpreter.h"
 
 using std::string;
-using std::cout;
 using namespace Lexer;
 
-Cell_stream Lexer::cs {std::cin};
-ostream* Lexer::outstream {&std::cout};
 double Lexer::equal_threshold {0.0000001};
+const string Lexer::empty_name;
+const List Lexer::empty_list;
 
-map<string, Kind> Lexer::keywords {{"define", Kind::Define}, {"lambda", Kind::Lambda}, {"cond", Kind::Cond},
+const map<string, Kind> Lexer::keywords {{"define", Kind::Define}, {"lambda", Kind::Lambda}, {"cond", Kind::Cond},
     {"cons", Kind::Cons}, {"car", Kind::Car}, {"cdr", Kind::Cdr}, {"list", Kind::List}, {"else", Kind::Else},
     {"empty?", Kind::Empty}, {"and", Kind::And}, {"or", Kind::Or}, {"not", Kind::Or}, {"cat", Kind::Cat},
-    {"include", Kind::Include}, {"begin", Kind::Begin}, {"let", Kind::Let}};
+    {"include", Kind::Include}, {"begin", Kind::Begin}, {"let", Kind::Let}, {"gc-stats", Kind::GcStats},
+    {"modulo", Kind::Modulo}, {"quotient", Kind::Quotient}, {"profile", Kind::Profile}, {"alloc-stats", Kind::AllocStats},
+    {"future", Kind::Future}, {"touch", Kind::Touch}, {"pmap", Kind::Pmap}, {"preduce", Kind::Preduce}};
+
+namespace {
+    constexpr size_t block_size {1 << 16};  // read at a time from streams
+
+    inline bool digit(char c) { return c >= '0' && c <= '9'; }
+
+    const double exact_tens[] {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    // decimal number at p, reading as much as istream >> double would and leaving p after it.
+    // digits alone that fit are an exact integer, otherwise up to 15 significant digits scaled by an
+    // exact power of ten come out correctly rounded from one multiplication or division, anything else
+    // goes through strtod
+    Cell number(const char*& p, const char* e, string& scratch) {
+        const char* start {p};
+        uint64_t digits {0};
+        int count {0};      // significant digits
+        int scale {0};
+        bool exact {true};
+        auto add = [&](char c) {
+            if (digits == 0 && c == '0') return;
+            if (count++ < 19) digits = digits * 10 + (c - '0');
+        };
+        for (; p != e && digit(*p); ++p) add(*p);
+        if (p != e && *p == '.') {
+            exact = false;
+            for (++p; p != e && digit(*p); ++p) { add(*p); --scale; }
+        }
+        if (p != e && (*p == 'e' || *p == 'E')) {
+            const char* q {p + 1};
+            bool negative {q != e && *q == '-'};
+            if (q != e && (*q == '+' || *q == '-')) ++q;
+            if (q != e && digit(*q)) {
+                int x {0};
+                for (; q != e && digit(*q); ++q) if (x < 100000) x = x * 10 + (*q - '0');
+                scale += negative? -x : x;
+                p = q;
+                exact = false;
+            }
+        }
+        if (exact && count <= 19 && digits <= uint64_t(LLONG_MAX)) return Cell{static_cast<long long>(digits)};
+        if (count <= 15 && scale >= -22 && scale <= 22)
+            return Cell{scale < 0? digits / exact_tens[-scale] : digits * exact_tens[scale]};
+        scratch.assign(start, p);
+        return Cell{strtod(scratch.c_str(), nullptr)};
+    }
+}
+
+Cell_stream::Source::~Source() {
+    if (map) munmap(map, size);
+    if (owns) delete ip;
+}
+
+void Cell_stream::set_input(istream& instream_ref) {
+    in.emplace_back(new Source);
+    in.back()->ip = &instream_ref;
+}
+
+void Cell_stream::set_input(istream* instream_pt) {
+    set_input(*instream_pt);
+    in.back()->owns = true;
+}
+
+void Cell_stream::open(const string& file) {
+    int fd {::open(file.c_str(), O_RDONLY)};
+    if (fd < 0) throw runtime_error("Cannot open " + file);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {    // pipes and devices are read like any stream
+        close(fd);
+        set_input(new ifstream{file});
+        return;
+    }
+    unique_ptr<Source> s {new Source};
+    s->ended = true;
+    if (st.st_size > 0) {
+        void* map {mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)};
+        if (map == MAP_FAILED) { close(fd); throw runtime_error("Cannot map " + file); }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        s->map = map;
+        s->size = st.st_size;
+        s->p = static_cast<const char*>(map);
+        s->end = s->p + s->size;
+    }
+    close(fd);
+    in.push_back(move(s));
+}
+
+bool Cell_stream::more() {
+    Source& s = *in.back();
+    if (s.ended) return false;
+    size_t kept = s.end - s.p;  // not scanned yet, moved to the front of the block
+    if (kept) memmove(s.block.data(), s.p, kept);
+    s.block.resize(kept + block_size);
+    if (s.ip->tie()) s.ip->tie()->flush();  // prompts before waiting for input
+    streamsize got {0};
+    if (s.ip == &cin) got = max<ssize_t>(read(STDIN_FILENO, s.block.data() + kept, block_size), 0);  // whatever is available, a line when interactive
+    else {
+        s.ip->read(s.block.data() + kept, block_size);
+        got = s.ip->gcount();
+    }
+    s.block.resize(kept + got);
+    s.p = s.block.data();
+    s.end = s.p + s.block.size();
+    s.window = nullptr;
+    if (got == 0) s.ended = true;
+    return got > 0;
+}
+
+const char* Cell_stream::skip(const char* p, bool space) {
+    Source& s = *in.back();
+    while (p < s.end) {     // each 64 bytes are classified once, tokens within them are then found from the bits
+        size_t at = p - s.window;
+        if (s.window == nullptr || p < s.window || at >= 64) {
+            s.window = p;
+            s.spaces = Scan::spaces(p, s.end);
+            at = 0;
+        }
+        uint64_t found {(space? s.spaces : ~s.spaces) >> at};
+        if (found) return min(p + __builtin_ctzll(found), s.end);
+        p = s.window + 64;
+    }
+    return s.end;
+}
+
+const char* Cell_stream::token_end() {
+    Source& s = *in.back();
+    const char* e {s.p};
+    while (true) {
+        e = skip(e, true);
+        if (e != s.end || s.ended) return e;
+        size_t scanned = e - s.p;
+        if (!more()) return s.end;
+        e = s.p + scanned;
+    }
+}
+
+void Cell_stream::ignoreln() {
+    Source& s = *in.back();
+    do {
+        const char* nl {Scan::newline(s.p, s.end)};
+        if (nl != s.end) { s.p = nl + 1; return; }
+        s.p = s.end;
+    } while (more());
+}
 
 Cell Cell_stream::get() {
-    // get 1 char, decide what kind of cell is incoming,
-    // appropriately get more char then return Cell
-    char c = 0;
+    // decide what kind of cell is incoming from its first char,
+    // then scan the rest of it from the buffer
+    Source& s = *in.back();
     do {  // skip all whitespace including newline
-        if(!ip->get(c)) return ct = {Kind::End};  // no char can be get from ip
-    } while (isspace(c));
+        s.p = skip(s.p, false);
+    } while (s.p == s.end && more());
+    if (s.p == s.end) return ct = {Kind::End};  // nothing left to read
 
+    char c {*s.p};
     switch (c) {
         case '!':
         case '&':
@@ -32,6 +188,12 @@ Cell Cell_stream::get() {
         case '+':
         case '-':
         case '/':
+        case ';':
+        case '<':
+        case '=':
+        case '>':
+        case '|':
+            ++s.p;
             return ct = {static_cast<Kind>(c)}; // primitive operators
         case '0':
         case '1':
@@ -42,70 +204,202 @@ Cell Cell_stream::get() {
         case '6':
         case '7':
         case '8':
-        case '9': {
-            ip->putback(c);
-            double temp;
-            *ip >> temp;
-            return ct = {temp};
+        case '9': {     // when all the text is there the number just stops at the first char not part of it
+            const char* e {s.ended? s.end : token_end()};
+            return ct = {number(s.p, e, token)};
         }
-        case ';':
-        case '<':
-        case '=':
-        case '>':
-        case '|':
-            return ct = {static_cast<Kind>(c)}; // primitive operators
-        case 'a':
-        case 'b':
-        case 'c':
-        case 'd':
-        case 'e':
-        case 'i':
-        case 'l':
-        case 'n':
-        case 'o': { // primitives coincidentally only start with c, d, e, or l...
-            ip->putback(c);
-            string temp;
-            *ip >> temp;
-            while (temp.back() == ')') {    // greedy reading of string adjacent to )
-                temp.pop_back();
-                ip->putback(')');
-            }
-            if (keywords.count(temp)) ct.kind = keywords[temp];
-            else { ct.kind = Kind::Name; ct.data = temp; }
-            return ct;
+        default: {    // name or keyword, up to whitespace without any ) it runs into
+            const char* e {token_end()};
+            while (e[-1] == ')') --e;
+            const Symbol* sym {symbols.intern(s.p, e - s.p)};
+            s.p = e;
+            if (sym->kind != Kind::Name) return ct = {sym->kind};
+            return ct = {sym};
         }
-        default: {    // name
-            ip->putback(c);
-            string temp;
-            *ip >> temp;
-            while (temp.back() == ')') {    // greedy reading of string adjacent to )
-                temp.pop_back();
-                ip->putback(')');
+    }
+}
+
+const Symbol* Lexer::intern(const string& name) {
+    return Interpreter::current().symbols.intern(name.data(), name.size());
+}
+
+Symbol_table::Symbol_table() : slots(64, Slot{0, nullptr}) {
+    for (auto& k : keywords) intern(k.first.data(), k.first.size(), k.second);
+}
+
+Symbol_table::~Symbol_table() {
+    for (auto& s : slots)
+        if (s.sym && --s.sym->refs == 0) delete s.sym;
+}
+
+const Symbol* Symbol_table::intern(const char* name, size_t length, Kind kind) {
+    size_t hash {14695981039346656037ull};  // FNV-1a
+    for (size_t i = 0; i < length; ++i) hash = (hash ^ static_cast<unsigned char>(name[i])) * 1099511628211ull;
+    size_t mask {slots.size() - 1};
+    size_t i {hash & mask};
+    for (; slots[i].sym; i = (i + 1) & mask) {
+        const Symbol* sym {slots[i].sym};
+        if (slots[i].hash == hash && sym->name.size() == length && memcmp(sym->name.data(), name, length) == 0) return sym;
+    }
+    Symbol* sym {new Symbol{string{name, length}, kind, true}};
+    slots[i] = {hash, sym};
+    if (++count * 2 > slots.size()) {   // rehash into twice the slots
+        vector<Slot> old(slots.size() * 2, Slot{0, nullptr});
+        old.swap(slots);
+        mask = slots.size() - 1;
+        for (auto& s : old) {
+            if (!s.sym) continue;
+            size_t j {s.hash & mask};
+            while (slots[j].sym) j = (j + 1) & mask;
+            slots[j] = s;
+        }
+    }
+    return sym;
+}
+
+Seq::Seq(const Cell& car, const Cell& cdr) : form{Form::Pair}, length{1}, whole{false}, head{car}, rest{cdr} {
+    Alloc::bytes(Alloc::Lists, sizeof(Seq));
+    if (const Seq* s = cdr.seq()) length += s->length;
+}
+
+Seq::Seq(const Cell& run, size_t from) : form{Form::Tail}, skip{from}, whole{false}, rest{run} {
+    length = run.seq()->length - from;
+    Alloc::bytes(Alloc::Lists, sizeof(Seq));
+}
+
+namespace {
+    bool last(const Cell& c) { return c.kind == Kind::Expr && c.seq() && c.seq()->refs == 1; }   // list going with its holder
+}
+
+Seq::~Seq() {   // lists nested in or chained from this one are released one at a time instead of through nested destructors
+    List dying;
+    Cell going;     // what it holds is taken out before it is released
+    for (Seq* s {this};;) {
+        for (auto& c : s->items) if (last(c)) dying.push_back(move(c));
+        if (last(s->head)) dying.push_back(move(s->head));
+        if (last(s->rest)) dying.push_back(move(s->rest));
+        if (dying.empty()) return;
+        going = move(dying.back());
+        dying.pop_back();
+        s = const_cast<Seq*>(going.seq());
+    }
+}
+
+const List& Cell::list() const {
+    const Seq* s {seq()};
+    if (s == nullptr) return empty_list;
+    if (!s->whole) {
+        s->items.reserve(s->length);
+        s->each([s](const Cell& c) { s->items.push_back(c); });
+        s->whole = true;
+        Alloc::copied(Alloc::Lists);    // flattening copies the elements of a consed or tail list
+        Alloc::bytes(Alloc::Lists, s->items.capacity() * sizeof(Cell));
+    }
+    return s->items;
+}
+
+Cell Lexer::cons(const Cell& car, const Cell& list) {
+    return {new Seq{car, list}};
+}
+
+Cell Lexer::tail(const Cell& list) {
+    const Seq* s {list.seq()};
+    if (s == nullptr || s->length < 2) return {List{}};
+    switch (s->form) {
+        case Seq::Form::Pair: return s->rest;
+        case Seq::Form::Tail: return {new Seq{s->rest, s->skip + 1}};   // tails always refer to a run
+        default: return {new Seq{list, 1}};
+    }
+}
+
+const Cell& Lexer::first(const Cell& list) {
+    const Seq* s {list.seq()};
+    if (s == nullptr || s->length == 0) throw runtime_error("Empty list has no first element");
+    switch (s->form) {
+        case Seq::Form::Pair: return s->head;
+        case Seq::Form::Tail: return s->rest.seq()->items[s->skip];
+        default: return s->items[0];
+    }
+}
+
+size_t Lexer::length(const Cell& list) {
+    const Seq* s {list.seq()};
+    return s? s->length : 0;
+}
+
+namespace {
+    void print_value(ostream* outstream, const Cell& cell, const char* end) {
+        switch (cell.kind) {
+            case Kind::Number: *outstream << cell.num() << end; break;
+            case Kind::Integer: *outstream << cell.fixnum() << end; break;
+            case Kind::Proc: *outstream << "proc" << end; break;
+            case Kind::Promise: *outstream << "future" << end; break;
+            case Kind::Expr: {
+                const List& list = cell.list();
+                *outstream << '(';
+                if (list.size() > 0) {
+                    auto p = list.begin();
+                    if(!p->numeric() && p->kind != Kind::Name && p->kind != Kind::Expr) *outstream << static_cast<char>(p->kind);    // primitive
+                    for (;p + 1 != list.end(); ++p)
+                        print_value(outstream, *p, " ");
+                    print_value(outstream, *p, "");
+                }
+                *outstream << ')' << end;
+                break;
             }
-            ct.data = temp;
-            ct.kind = Kind::Name;
-            return ct;
+            default: *outstream << cell.name() << end;
         }
     }
+
+    void print_cell(ostream& os, const Cell& cell, const char* end) {
+        if(!cell.numeric() && cell.kind != Kind::Name && cell.kind != Kind::Expr) os << static_cast<char>(cell.kind);    // primitive
+        print_value(&os, cell, end);
+    }
 }
 
 void Lexer::print(const Cell& cell) {
-    if(cell.kind != Kind::Number && cell.kind != Kind::Name && cell.kind != Kind::Expr) *outstream << static_cast<char>(cell.kind);    // primitive
-    boost::apply_visitor(print_visitor(), cell.data);
+    print_cell(*Interpreter::current().outstream, cell, " ");
+}
+
+void Lexer::print(ostream& os, const Cell& cell) {
+    print_cell(os, cell, "");
 }
 
 std::ostream& Lexer::operator<<(ostream& os, const Cell& c) {
-    print(c);
+    print_cell(os, c, " ");
     return os;
 }
 
+// cells compare as the kind of the first one, against an empty value if the second is of another kind.
+// two integers compare exactly, numbers of either kind otherwise as doubles
 bool Lexer::operator<(const Cell& a, const Cell& b) {
-    if (a.kind == Kind::Number)
-        return boost::apply_visitor(less_visitor(boost::get<double>(a.data)), b.data);
-    return boost::apply_visitor(less_visitor(boost::get<string>(a.data)), b.data);
+    bool number {a.numeric()};
+    const string& s {number? empty_name : a.name()};
+    switch (b.kind) {
+        case Kind::Number: case Kind::Integer:
+            if (a.kind == Kind::Integer && b.kind == Kind::Integer) return a.fixnum() < b.fixnum();
+            return (number? a.num() : 0) < b.num();
+        case Kind::Expr: return length(b) != 0;
+        case Kind::Proc: throw runtime_error("Procedures cannot be ordered");
+        default: return s < b.name();
+    }
 }
 bool Lexer::operator==(const Cell& a, const Cell& b) {
-     if (a.kind == Kind::Number)
-        return boost::apply_visitor(equal_visitor(boost::get<double>(a.data)), b.data);
-    return boost::apply_visitor(equal_visitor(boost::get<string>(a.data)), b.data);
+    bool number {a.numeric()};
+    const string& s {number? empty_name : a.name()};
+    switch (b.kind) {
+        case Kind::Number: case Kind::Integer: {
+            if (a.kind == Kind::Integer && b.kind == Kind::Integer) return a.fixnum() == b.fixnum();
+            double n {number? a.num() : 0};
+            if (n < b.num()) return b.num() - n < equal_threshold; else return n - b.num() < equal_threshold;
+        }
+        case Kind::Expr: return length(b) == 0;
+        case Kind::Proc: return false;
+        default: {
+            const Symbol* x {number? nullptr : a.sym()};
+            const Symbol* y {b.sym()};
+            if (x && y && x->interned && y->interned) return x == y;    // no need to compare the names
+            return s == b.name();
+        }
+    }
 }
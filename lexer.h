@@ -4,151 +4,247 @@
 #include <iostream>
 #include <map>
 #include <memory>   // shared_ptr
-#include "boost/variant.hpp"
+#include <stdexcept>
 #include "forward.h"
+#include "alloc.h"
 
 
 
 namespace Lexer {
     using namespace std;
 	extern double equal_threshold;
-	extern ostream* outstream;
     enum class Kind : char {
         Include, 
-        Begin, Cat, Cons, Car, Cdr, List, Let,   // primitive procs
-        Define = 'd', Lambda = 'l', Number = '#', Name = 'n', Expr = 'e', Proc = 'p', False = 'f', True = 't', Cond = 'c', Else = ',', End = '.', Empty = ' ',   // special cases
+        Begin, Cat, Cons, Car, Cdr, List, Let, GcStats, Modulo, Quotient, Profile, AllocStats, Future, Touch, Pmap, Preduce,   // primitive procs
+        Define = 'd', Lambda = 'l', Number = '#', Integer = 'i', Name = 'n', Expr = 'e', Proc = 'p', False = 'f', True = 't', Cond = 'c', Else = ',', End = '.', Empty = ' ', Undefined = '?', Promise = '@',   // special cases
         Quote = '\'', Lp = '(', Rp = ')', And = '&', Not = '!', Or = '|',
         Mul = '*', Add = '+', Sub = '-', Div = '/', Less = '<', Equal = '=', Greater = '>',  // primitive operators
         Comment = ';'
     };
 
-    struct Proc {
-        List params;    
-        List body;
-        Environment::Env* env;
+    struct Proc;
+
+    struct Counted {    // heap payload of a cell, shared by its copies
+        size_t refs {1};
+    };
+
+    struct Symbol : Counted, Alloc::Tally<Alloc::Strings> {   // payload of name cells, interned symbols are unique within their interpreter
+        Symbol(string n, Kind k = Kind::Name, bool i = false) : name(move(n)), kind{k}, interned{i} {
+            Alloc::bytes(Alloc::Strings, sizeof(Symbol) + name.capacity());
+        }
+        string name;
+        Kind kind;      // Kind::Name or the keyword it spells
+        bool interned;
+    };
+    const Symbol* intern(const string& name);   // the unique symbol for name in the interpreter in use, keywords are recognized here once
+
+    class Symbol_table {    // interned symbols of one interpreter, found from the text of a name without copying it
+    public:
+        Symbol_table();     // holding the keywords
+        ~Symbol_table();    // cells, including ones outlasting the table, hold their own references
+        Symbol_table(const Symbol_table&) = delete;
+        Symbol_table& operator=(const Symbol_table&) = delete;
+
+        const Symbol* intern(const char* name, size_t length, Kind kind = Kind::Name);  // kind is given to a new symbol
+
+    private:
+        struct Slot {
+            size_t hash;
+            Symbol* sym;    // nullptr if free
+        };
+        vector<Slot> slots;     // open addressing, size a power of two at most half full
+        size_t count {0};
     };
 
-    using Data = boost::variant<string, double, Proc*, List>;  // could make List into List*, but then introduce more management issues and indirection
+    struct Seq;     // payload of list cells, defined below
 
-    struct Cell {
+    struct Promise : Counted {  // payload of future cells, shared with the thread computing the value
+        explicit Promise(shared_ptr<Parallel::Task> t) : task(move(t)) {}
+        shared_ptr<Parallel::Task> task;
+    };
+
+    constexpr const char* bad_get {"Value of unexpected kind"};    // thrown by the accessors of Cell
+    extern const string empty_name;
+    extern const List empty_list;
+
+    struct Cell : Alloc::Tally<Alloc::Cells> {  // 16 bytes, numbers and procedures held inline, names and lists behind one counted pointer
         Kind kind;
-        Data data;
 
         // constructors
         Cell() : kind{Kind::End} {} // need default for vector storage
         Cell(Kind k) : kind{k} {}
-        Cell(const double n) : kind{Kind::Number}, data{n} {}
-        Cell(const string& s) : kind{Kind::Name}, data{s} {}
-        Cell(const char* s) : kind{Kind::Name}, data{s} {}
-        Cell(Proc* p) : kind{Kind::Proc}, data{p} {}
-        Cell(List l) : kind{Kind::Expr}, data{l} {}
+        Cell(const double n) : kind{Kind::Number} { data.num = n; }
+        Cell(const long long n) : kind{Kind::Integer} { data.fixnum = n; }
+        Cell(const string& s) : kind{Kind::Name} { data.box = new Symbol{s}; }    // uninterned, as made by cat
+        Cell(const char* s) : kind{Kind::Name} { data.box = new Symbol{s}; }
+        Cell(const Symbol* s) : kind{Kind::Name} { data.box = const_cast<Symbol*>(s); ++data.box->refs; }
+        Cell(Proc* p) : kind{Kind::Proc} { data.proc = p; }
+        Cell(List l);
+        Cell(Seq* s);
+        Cell(Promise* p) : kind{Kind::Promise} { data.box = p; }
         explicit Cell(bool b) : kind{b? Kind::True : Kind::False} {}
 
-        // copy and move constructors
-        Cell(const Cell&) = default;
-        Cell& operator=(const Cell&) = default;
-        Cell(Cell&&) = default;
-        Cell& operator=(Cell&&) = default;
+        // copy and move constructors, copies share names and lists which are never modified in place
+        Cell(const Cell& c) : Tally(c), kind{c.kind}, data(c.data) { if (boxed()) ++data.box->refs; }
+        Cell& operator=(const Cell& c) { Cell t {c}; swap(t); return *this; }
+        Cell(Cell&& c) noexcept : Tally(move(c)), kind{c.kind}, data(c.data) { c.kind = Kind::End; c.data.box = nullptr; }
+        Cell& operator=(Cell&& c) noexcept { Alloc::moved(Alloc::Cells); swap(c); return *this; }
 
-        ~Cell() = default;
+        ~Cell();
+
+        // access to the value, throws bad_get if the cell holds another kind
+        double num() const {    // integers as well, converted
+            if (kind == Kind::Integer) return data.fixnum;
+            if (kind != Kind::Number) throw runtime_error(bad_get);
+            return data.num;
+        }
+        long long fixnum() const { return data.fixnum; }    // unchecked, for kind Integer
+        bool numeric() const { return kind == Kind::Number || kind == Kind::Integer; }
+        Proc* proc() const { if (kind != Kind::Proc) throw runtime_error(bad_get); return data.proc; }
+        const string& name() const {    // names, strings and keywords (which have an empty name)
+            if (numeric() || kind == Kind::Proc || kind == Kind::Expr || kind == Kind::Promise) throw runtime_error(bad_get);
+            return data.box? static_cast<const Symbol*>(data.box)->name : empty_name;
+        }
+        const Symbol* sym() const {     // nullptr for keywords
+            if (numeric() || kind == Kind::Proc || kind == Kind::Expr || kind == Kind::Promise) throw runtime_error(bad_get);
+            return static_cast<const Symbol*>(data.box);
+        }
+        const List& list() const;   // all elements, a consed or tail list is flattened (once) to provide them
+        const Seq* seq() const;     // nullptr for a cell made from Kind::Expr alone
+        const Promise* promise() const { if (kind != Kind::Promise) throw runtime_error(bad_get); return static_cast<const Promise*>(data.box); }
 
         // conversion operators
         operator bool() { return kind != Kind::False; }
+
+    private:
+        union Data {
+            Counted* box;
+            double num;
+            long long fixnum;   // exact integers, as read from literals without a point or exponent
+            Proc* proc;
+        } data {nullptr};
+
+        bool boxed() const { return !numeric() && kind != Kind::Proc && data.box; }
+        void swap(Cell& c) { std::swap(kind, c.kind); std::swap(data, c.data); }
     };
+    static_assert(sizeof(Cell) == 16, "Cell should be a tag and one word");
 
-    class Cell_stream {
+    // lists are never modified, so they are shared between copies and consing onto or taking the tail of
+    // a list shares its elements instead of copying them
+    struct Seq : Counted, Alloc::Tally<Alloc::Lists> {
+        enum class Form : char { Run, Pair, Tail };
+
+        Seq(List l) : form{Form::Run}, length{l.size()}, whole{true}, items(move(l)) {
+            Alloc::bytes(Alloc::Lists, sizeof(Seq) + items.capacity() * sizeof(Cell));
+        }
+        Seq(const Cell& car, const Cell& cdr);  // car in front of the elements of list cdr
+        Seq(const Cell& run, size_t from);      // elements of run from index from on
+        ~Seq();
+
+        Form form;
+        size_t length;
+        size_t skip {0};        // for tails
+        mutable bool whole;     // items holds all elements
+        mutable List items;
+        Cell head;              // car of a pair
+        Cell rest;              // cdr of a pair, run of a tail
+        mutable size_t seen {0};    // last garbage collection that marked it
+
+        template <typename F>
+        void each(F f) const {  // every element, without flattening
+            for (const Seq* s {this}; s != nullptr;) {
+                if (s->whole) { for (auto& c : s->items) f(c); return; }
+                if (s->form == Form::Tail) {
+                    const List& run = s->rest.seq()->items;
+                    for (auto p = run.begin() + s->skip; p != run.end(); ++p) f(*p);
+                    return;
+                }
+                f(s->head);
+                s = s->rest.seq();
+            }
+        }
+    };
+
+    struct Proc {
+        Cell params;    // lists of the parsed program, shared rather than copied
+        Cell body;
+        Environment::Env* env;
+        shared_ptr<Bytecode::Code> code;    // compiled body, filled in on first call by the VM
+        size_t calls;       // made by the VM
+        const JIT::Native* native;  // machine code, once hot if the body allows
+    };
+
+    // O(1) operations on cells holding lists
+    Cell cons(const Cell& car, const Cell& list);   // list with car in front
+    Cell tail(const Cell& list);        // list without its first element
+    const Cell& first(const Cell& list);
+    size_t length(const Cell& list);
+
+    inline Cell::Cell(List l) : kind{Kind::Expr} { data.box = new Seq{move(l)}; }
+    inline Cell::Cell(Seq* s) : kind{Kind::Expr} { data.box = s; }
+    inline Cell::~Cell() {
+        if (!boxed() || --data.box->refs) return;
+        if (kind == Kind::Expr) delete static_cast<Seq*>(data.box);
+        else if (kind == Kind::Promise) delete static_cast<Promise*>(data.box);
+        else delete static_cast<Symbol*>(data.box);
+    }
+    inline const Seq* Cell::seq() const {
+        if (kind != Kind::Expr) throw runtime_error(bad_get);
+        return static_cast<const Seq*>(data.box);
+    }
+
+    class Cell_stream {     // scans contiguous text, files are mapped and other streams read a block at a time
     public:
-        Cell_stream(istream& instream_ref) : ip{&instream_ref} {}
-        Cell_stream(istream* instream_pt)  : ip{instream_pt}, owns{instream_pt} {}
+        Cell_stream(istream& instream_ref, Symbol_table& table) : symbols(table) { set_input(instream_ref); }
 
         Cell get();    // get and return next cell
         const Cell& current() { return ct; } // most recently get cell
-        bool eof() { return ip->eof(); }
-        bool base() { return old.size() == 0; }
-        void reset() { if (owns.back() == ip) { delete owns.back(); owns.pop_back(); } ip = old.back(); old.pop_back(); }
-        void ignoreln() { ip->ignore(9001, '\n'); }
+        bool eof() { const Source& s = *in.back(); return s.ended && s.p == s.end; }   // nothing left of the input in use
+        bool base() { return in.size() == 1; }
+        void reset() { in.pop_back(); }     // back to the input used before the last set_input or open
+        void ignoreln();
 
-        void set_input(istream& instream_ref) { old.push_back(ip); ip = &instream_ref; }
-        void set_input(istream* instream_pt) { old.push_back(ip); ip = instream_pt; owns.push_back(ip); }
+        // for switching between inputs through include
+        void set_input(istream& instream_ref);
+        void set_input(istream* instream_pt);   // deleted once done with
+        void open(const string& file);
 
     private:
-        // void close() { if (owns) delete ip; }
-        istream* ip;    // input stream pointer
-        vector<istream*> old;  // for switching between input streams through include
-        vector<istream*> owns;
+        struct Source {
+            Source() = default;
+            Source(const Source&) = delete;
+            Source& operator=(const Source&) = delete;
+            ~Source();
+
+            const char* p {nullptr};    // next char to scan
+            const char* end {nullptr};
+            bool ended {false};     // nothing more to read beyond end
+            istream* ip {nullptr};  // read from when p reaches end
+            bool owns {false};
+            vector<char> block;     // text read from ip, what p has passed is dropped on the next read
+            void* map {nullptr};    // or the whole file mapped
+            size_t size {0};
+            const char* window {nullptr};   // start of the last 64 bytes classified
+            uint64_t spaces {0};    // whitespace bits of those bytes
+        };
+
+        bool more();    // read another block into the source in use, false if there is nothing left
+        const char* skip(const char* p, bool space);    // first whitespace from p (or first other char), or end
+        const char* token_end();    // end of the token starting at p, reading more if it may continue past end
+
+        vector<unique_ptr<Source>> in;  // last one in use, others to resume once it is done
+        Symbol_table& symbols;  // names are interned into
+        string token;   // scratch for numbers handed to strtod
         Cell ct {Kind::End};   // current token, default value in case of misuse
     };
 
     // overloaded operators 
-    ostream& operator<<(ostream&, const Cell&);
+    ostream& operator<<(ostream&, const Cell&);    // as print(const Cell&) does, to the stream given
     bool operator<(const Cell&, const Cell&);
     bool operator==(const Cell&, const Cell&);
-    void print(const Cell&);
-
-    extern Cell_stream cs;
-    extern map<string, Kind> keywords;
-
+    void print(const Cell&);    // to the output of the interpreter in use
+    void print(ostream& os, const Cell&);   // without the trailing space
 
-
-    // visitors
-    class print_visitor : public boost::static_visitor<> {
-        string end {" "};
-    public:
-        print_visitor() {}
-        print_visitor(string e) : end{e} {}
-        void operator()(const string& str) const {
-            *outstream << str << end;
-        }
-        void operator()(const double num) const {
-            *outstream << num << end;
-        }
-        void operator()(const Lexer::Proc* proc) const {
-            *outstream << "proc" << end;
-        }
-        void operator()(const Lexer::List list) const {
-            *outstream << '(';
-            if (list.size() > 0) {
-                auto p = list.begin();
-                if(p->kind != Kind::Number && p->kind != Kind::Name && p->kind != Kind::Expr) cout << static_cast<char>(p->kind);    // primitive
-                for (;p + 1 != list.end(); ++p) 
-                    boost::apply_visitor(print_visitor(), p->data);
-                boost::apply_visitor(print_visitor(""), p->data);
-            }
-            *outstream << ')' << end;
-        }
-    };
-
-    class less_visitor : public boost::static_visitor<bool> {
-        // first elements stored, second elements taken as operand
-        string str;
-        double num;
-        List list;
-        Proc* proc;
-    public:
-        less_visitor(const string& s) : str{s} {}
-        less_visitor(const double d) : num{d} {}
-        less_visitor(Proc* const p) : proc(p) {}
-        less_visitor(const List& l) : list{l} {}
-        bool operator()(const string& s) const { return str < s; }
-        bool operator()(const double n) const { return num < n; }
-        bool operator()(Proc* const p) const { return (*proc).body < (*p).body; }
-        bool operator()(const List& l) const { return list < l; }
-    };
-
-    class equal_visitor : public boost::static_visitor<bool> {
-        string str;
-        double num;
-        List list;
-        Proc* proc;
-    public:
-        equal_visitor(const string& s) : str{s} {}
-        equal_visitor(const double d) : num{d} {}
-        equal_visitor(Proc* const p) : proc(p) {}
-        equal_visitor(const List& l) : list{l} {}
-        bool operator()(const string& s) const { return str == s; }
-        bool operator()(const double n) const { if (num < n) return n - num < equal_threshold; else return num - n < equal_threshold; }
-        bool operator()(Proc* const p) const { return proc == p; }
-        bool operator()(const List& l) const { return list == l; }
-    };
+    extern const map<string, Kind> keywords;
 }
 #endif
@@ -1,26 +1,38 @@
-#include <fstream>
-#include "parser.h"
-#include "lexer.h"
-#include "environment.h"
+#include "interpreter.h"
+#include "counters.h"
 #include "error.h"
 
 using namespace Lexer;
-using namespace Parser;
-using namespace Environment;
 
 namespace Driver {
-    void start(bool print_res) {
-        envs.reserve(max_capacity * 4); // reserve to preserve pointers
-        procs.reserve(max_capacity);
-        envs.push_back(e0);
+    struct Counted {    // hardware counts of every top level evaluation, for -counters
+        Counters::Group group;
+        Counters::Sample total;
+        size_t exprs {0};
+    };
 
+    void start(Interpreter& clisp, bool print_res, Counted* counted) {
+        Interpreter::Use use {clisp};
+        Cell_stream& cs = clisp.cs;
         while (true) {
             if (print_res) cout << "> ";
             try {
-                auto res = eval(expr(true), &e0);
+                auto read = clisp.expr();
+                if (counted) counted->group.start();
+                auto res = clisp.eval(read);
+                if (counted && res.kind != Kind::End) {
+                    Counters::Sample s {counted->group.stop()};
+                    counted->total += s;
+                    ++counted->exprs;
+                    Counters::print(cerr << "counters: ", s);
+                    cerr << '\n';
+                }
                 if (print_res)
                     cout << res << '\n';    
-                if (res.kind == Kind::End || cs.eof()) { cs.reset(); if (cs.base()) print_res = true; }
+                if (res.kind == Kind::End || cs.eof()) {
+                    if (!cs.base()) { cs.reset(); if (cs.base()) print_res = true; }
+                    else if (cs.eof()) return;  // end of standard input
+                }
             }
             catch (exception& e) {
                 cout << e.what() << endl;    // continue loop
@@ -30,25 +42,38 @@ namespace Driver {
 }
 
 int main(int argc, char* argv[]) {
-    bool print_res {false};
-    switch (argc) {
-        case 1:
-            print_res = true;
-            break;
-        case 2:
-            cs.set_input(new ifstream{argv[1]});
-            break;
-        case 3: {
-            cs.set_input(new ifstream{argv[1]});
-            string option {argv[2]};
-            if (option == "-p" || option == "-print") print_res = true;
-            break;
-        }
-        default:
-            throw runtime_error("too many arguments");
-            return 1;
+    Interpreter clisp;
+    bool print_res {argc == 1};
+    bool profile {false};
+    bool counters {false};
+    if (argc > 1 && argv[1][0] != '-') clisp.cs.open(argv[1]);
+    else print_res = true;
+    for (int i = 1; i < argc; ++i) {
+        string option {argv[i]};
+        if (option == "-p" || option == "-print") print_res = true;
+        else if (option == "-ref") clisp.reference = true;  // tree walking eval kept for comparison
+        else if (option == "-nojit") clisp.jit = false;     // bytecode only
+        else if (option == "-prof") profile = true;         // report on stderr at the end, stacks in clisp.folded
+        else if (option == "-counters") counters = true;    // cycles, instructions and misses of each expression on stderr
+        else if (option == "-depth" && i + 1 < argc) clisp.max_depth = stoul(argv[++i]);   // nested calls allowed
+        else if (option[0] == '-' || i > 1) throw runtime_error("unrecognized argument " + option);
+    }
+    if (profile) clisp.profiler.start();
+    unique_ptr<Driver::Counted> counted {counters? new Driver::Counted : nullptr};
+    if (counted && !counted->group.available()) {
+        cerr << "counters unavailable, " << counted->group.reason() << '\n';
+        counted.reset();
+    }
+    Driver::start(clisp, print_res, counted.get());
+    if (counted) {
+        Counters::print(cerr << "counters: " << counted->exprs << " expressions, per expression ", counted->total, counted->exprs);
+        cerr << '\n';
+    }
+    if (profile) {
+        Interpreter::Use use {clisp};
+        clisp.profiler.stop(cerr);
     }
-    Driver::start(print_res);
+    if (Alloc::enabled) Alloc::dump(cerr);
 
     return 0;
 }
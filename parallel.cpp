@@ -0,0 +1,507 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
+#include "parallel.h"
+#include "interpreter.h"
+#include "gc.h"
+#include "error.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace Parallel;
+using Environment::Env;
+
+struct Parallel::Task {     // a future, or a chunk of a pmap or preduce
+    Package work;           // the thunk, or the elements of the chunk
+    Package result;
+    string error;           // thrown while computing it
+    atomic<bool> claimed {false};   // by whoever runs it, the thread asking for a chunk runs it itself if no one has
+    mutex m;
+    condition_variable cv;
+    bool done {false};
+
+    void finish(Package r, string e) {
+        lock_guard<mutex> l {m};
+        result = move(r);
+        error = move(e);
+        done = true;
+        cv.notify_all();
+    }
+};
+
+namespace {
+    class Packer {
+    public:
+        Packer(Package& p, bool g, Env* top) : pkg(p), globals{g}, e0{top? top : &Interpreter::current().e0} {}
+
+        Value value(const Cell& c) {
+            Value v;
+            v.kind = c.kind;
+            switch (c.kind) {
+                case Kind::Number: v.num = c.num(); break;
+                case Kind::Integer: v.fixnum = c.fixnum(); break;
+                case Kind::Proc: v.proc = proc(c.proc()); break;
+                case Kind::Promise: v.task = c.promise()->task; break;
+                case Kind::Expr:
+                    if (const Seq* s = c.seq()) {
+                        v.boxed = true;
+                        v.items.reserve(s->length);
+                        s->each([&](const Cell& x) { v.items.push_back(value(x)); });
+                    }
+                    break;
+                default:
+                    if (const Symbol* s = c.sym()) {
+                        v.boxed = true;
+                        v.name = s->name;
+                        v.interned = s->interned;
+                        if (text && s->interned) named(s);
+                    }
+            }
+            return v;
+        }
+
+        void finish() {     // the global bindings named, including by the procedures bound to them
+            if (!globals) return;
+            for (size_t i = 0; i < names.size(); ++i) {
+                Cell* c {e0->find(names[i])};
+                if (c) {
+                    Value v {value(*c)};
+                    pkg.globals.emplace_back(names[i]->name, move(v));
+                }
+            }
+        }
+    private:
+        Package& pkg;
+        bool globals;
+        Env* e0;    // or the environment of a task standing for it
+        unordered_map<const Proc*, size_t> procs;
+        unordered_map<const Env*, size_t> envs;
+        unordered_map<const Bytecode::Code*, size_t> codes;
+        vector<const Symbol*> names;
+        unordered_set<const Symbol*> seen;
+        int text {0};   // inside program text, whose names may be global
+
+        void named(const Symbol* s) { if (globals && seen.insert(s).second) names.push_back(s); }
+
+        Value program(const Cell& c) {
+            ++text;
+            Value v {value(c)};
+            --text;
+            return v;
+        }
+
+        size_t proc(const Proc* p) {
+            auto found = procs.find(p);
+            if (found != procs.end()) return found->second;
+            size_t i {pkg.procs.size()};
+            procs[p] = i;
+            pkg.procs.emplace_back();
+            Package::Proc x;
+            x.params = program(p->params);
+            x.body = program(p->body);
+            x.env = env(p->env);
+            x.code = p->code? code(p->code.get()) : Package::global;
+            pkg.procs[i] = move(x);     // by index, packing it may have added more
+            return i;
+        }
+
+        size_t env(Env* e) {    // outer environments come first, so they are built first
+            if (e == nullptr || e == e0) return Package::global;
+            auto found = envs.find(e);
+            if (found != envs.end()) return found->second;
+            size_t outer {env(e->parent())};
+            size_t i {pkg.envs.size()};
+            envs[e] = i;
+            pkg.envs.emplace_back();
+            Package::Env x;
+            x.outer = outer;
+            e->bindings([&](const Symbol* s, const Cell& c) { x.bindings.emplace_back(s->name, value(c)); });
+            for (size_t k = 0; k < e->slot_count(); ++k) x.slots.push_back(value(e->slot(k)));
+            pkg.envs[i] = move(x);
+            return i;
+        }
+
+        size_t code(const Bytecode::Code* c) {
+            auto found = codes.find(c);
+            if (found != codes.end()) return found->second;
+            size_t i {pkg.codes.size()};
+            codes[c] = i;
+            pkg.codes.emplace_back();
+            Package::Code x;
+            x.instrs = c->instrs;
+            for (auto& k : c->consts) x.consts.push_back(program(k));
+            for (auto n : c->names) x.names.push_back(n->name);
+            for (auto& g : c->globals) {
+                x.globals.push_back({g.name->name, g.depth});
+                named(g.name);
+            }
+            x.addrs = c->addrs;
+            x.lets = c->lets;
+            for (auto& t : c->procs)
+                x.procs.push_back({{program(t.params), program(t.body)}, t.code? code(t.code.get()) : Package::global});
+            x.frame = c->frame;
+            x.captures = c->captures;
+            pkg.codes[i] = move(x);
+            return i;
+        }
+    };
+
+    class Unpacker {
+    public:
+        Unpacker(const Package& p, Env* t) : pkg(p), top{t? t : &Interpreter::current().e0} {}
+
+        List build() {  // nothing built is reachable before the end, so nothing is collected until then
+            GC::Hold hold;
+            for (auto& x : pkg.envs)
+                envs.push_back(GC::env(x.slots.size(), x.outer == Package::global? top : envs[x.outer]));
+            for (auto& x : pkg.procs)
+                procs.push_back(GC::proc(Cell{}, Cell{}, x.env == Package::global? top : envs[x.env]));
+            codes.resize(pkg.codes.size());
+            for (size_t i = 0; i < pkg.procs.size(); ++i) {
+                const Package::Proc& x = pkg.procs[i];
+                procs[i]->params = value(x.params);
+                procs[i]->body = value(x.body);
+                procs[i]->code = code(x.code);
+            }
+            for (size_t i = 0; i < pkg.envs.size(); ++i) {
+                const Package::Env& x = pkg.envs[i];
+                for (auto& b : x.bindings) (*envs[i])[intern(b.first)] = value(b.second);
+                for (size_t k = 0; k < x.slots.size(); ++k) envs[i]->slot(k) = value(x.slots[k]);
+            }
+            for (auto& b : pkg.globals) (*top)[intern(b.first)] = value(b.second);
+            List res;
+            res.reserve(pkg.values.size());
+            for (auto& v : pkg.values) res.push_back(value(v));
+            return res;
+        }
+    private:
+        const Package& pkg;
+        Env* top;
+        vector<Env*> envs;
+        vector<Proc*> procs;
+        vector<shared_ptr<Bytecode::Code>> codes;
+
+        Cell value(const Value& v) {
+            switch (v.kind) {
+                case Kind::Number: return Cell{v.num};
+                case Kind::Integer: return Cell{v.fixnum};
+                case Kind::Proc: return Cell{procs[v.proc]};
+                case Kind::Promise: return Cell{new Lexer::Promise{v.task}};
+                case Kind::Expr: {
+                    if (!v.boxed) return Cell{Kind::Expr};
+                    List l;
+                    l.reserve(v.items.size());
+                    for (auto& x : v.items) l.push_back(value(x));
+                    return Cell{move(l)};
+                }
+                default: {
+                    if (!v.boxed) return Cell{v.kind};
+                    Cell c {v.interned? Cell{intern(v.name)} : Cell{v.name}};
+                    c.kind = v.kind;
+                    return c;
+                }
+            }
+        }
+
+        shared_ptr<Bytecode::Code> code(size_t i) {
+            if (i == Package::global) return nullptr;
+            if (codes[i]) return codes[i];
+            auto c = make_shared<Bytecode::Code>();
+            codes[i] = c;
+            const Package::Code& x = pkg.codes[i];
+            c->instrs = x.instrs;
+            for (auto& k : x.consts) c->consts.push_back(value(k));
+            for (auto& n : x.names) c->names.push_back(intern(n));
+            for (auto& g : x.globals) c->globals.push_back({intern(g.name), g.depth, nullptr, nullptr});
+            c->addrs = x.addrs;
+            c->lets = x.lets;
+            for (auto& t : x.procs) c->procs.push_back({value(t.first.first), value(t.first.second), code(t.second)});
+            c->frame = x.frame;
+            c->captures = x.captures;
+            return c;
+        }
+    };
+
+    thread_local Pool* member {nullptr};    // pool of a worker thread
+    thread_local size_t own {0};            // its queue
+
+    size_t threads_wanted() {
+        const char* n {getenv("CLISP_THREADS")};
+        size_t threads {n? size_t(strtoul(n, nullptr, 10)) : thread::hardware_concurrency()};
+        return threads > 1? threads - 1 : 0;    // the thread asking counts as one
+    }
+
+    bool inside(const Pool& pool) { return member == &pool; }
+
+    Env* task_env() {   // standing for e0 in a task, given the globals it names and collected once the task ends
+        Env* e {GC::env(&Interpreter::current().e0)};
+        e->seal();
+        return e;
+    }
+
+    void wait(Task& t) {    // a thread of the pool runs other tasks meanwhile, which may be the ones t waits on
+        Pool& pool = Pool::get();
+        while (true) {
+            {
+                unique_lock<mutex> l {t.m};
+                if (t.done) return;
+                if (!inside(pool)) { t.cv.wait(l, [&t] { return t.done; }); return; }
+            }
+            if (pool.run_one()) continue;
+            unique_lock<mutex> l {t.m};
+            t.cv.wait_for(l, chrono::milliseconds(1), [&t] { return t.done; });
+        }
+    }
+
+    long long since(chrono::steady_clock::time_point start) {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    struct Job {    // a pmap or preduce, f applied over chunks of a list
+        Package f;
+        vector<unique_ptr<Task>> chunks;
+        bool reduce;
+    };
+
+    // on a worker: the chunk's elements mapped by f, or folded with it from the first
+    void run(const Job& job, Task& chunk) {
+        if (chunk.claimed.exchange(true)) return;
+        Package out;
+        string error;
+        try {
+            Interpreter& in = Interpreter::current();
+            Env* top {task_env()};
+            GC::Root roottop {top};
+            List f = unpack(job.f, top);
+            GC::Root rootf {f};
+            List xs = unpack(chunk.work, top);
+            GC::Root rootxs {xs};
+            List res;
+            GC::Root rootres {res};
+            if (job.reduce) {
+                res.push_back(xs[0]);
+                for (size_t i = 1; i < xs.size(); ++i) res[0] = in.apply(f[0], List{res[0], xs[i]});
+            }
+            else for (auto& x : xs) res.push_back(in.apply(f[0], List{x}));
+            out = pack(res.data(), res.data() + res.size(), false, top);
+        }
+        catch (exception& e) { error = e.what(); }
+        chunk.finish(move(out), move(error));
+    }
+
+    // applies f to each element from the first on, or folds them, spreading the work over the pool once the
+    // time taken by the first application says it is worth it. results are in order, one per chunk if reduce
+    List spread(const Cell& fn, const Cell& list, bool reduce) {
+        Cell f {fn}, seq {list};    // copies, the arguments may be on the VM's stack which applying f can move
+        GC::Root rootf {f}, rootseq {seq};
+        if (f.kind != Kind::Proc) throw runtime_error(reduce? "preduce expects a procedure" : "pmap expects a procedure");
+        if (seq.kind != Kind::Expr) throw runtime_error(reduce? "preduce expects a list" : "pmap expects a list");
+        const List& xs = seq.list();
+        Interpreter& in = Interpreter::current();
+        List res;
+        GC::Root rootres {res};
+        if (xs.empty() || (reduce && xs.size() == 1)) { res.assign(xs.begin(), xs.end()); return res; }
+
+        size_t from {reduce? size_t(2) : size_t(1)};    // the first application is timed
+        auto start = chrono::steady_clock::now();
+        res.push_back(reduce? in.apply(f, List{xs[0], xs[1]}) : in.apply(f, List{xs[0]}));
+        long long each {max(since(start), 1LL)};
+        size_t n {xs.size() - from};
+        Pool& pool = Pool::get();
+        if (pool.workers() == 0 || each * (long long)n < inline_ns) {
+            for (size_t i = from; i < xs.size(); ++i)
+                if (reduce) res[0] = in.apply(f, List{res[0], xs[i]});
+                else res.push_back(in.apply(f, List{xs[i]}));
+            return res;
+        }
+
+        size_t threads {pool.workers() + 1};
+        size_t per {max(size_t((chunk_ns + each - 1) / each), (n + 4 * threads - 1) / (4 * threads))};
+        auto job = make_shared<Job>();
+        job->f = pack(&f, &f + 1, true);
+        job->reduce = reduce;
+        for (size_t b = from; b < xs.size(); b += per) {
+            job->chunks.emplace_back(new Task);
+            job->chunks.back()->work = pack(xs.data() + b, xs.data() + min(b + per, xs.size()), false);
+        }
+        for (auto& c : job->chunks) {
+            Task* chunk {c.get()};
+            pool.submit([job, chunk] { run(*job, *chunk); });
+        }
+
+        // the chunks no one has started yet are done here from the last, with the elements as they are
+        List mine(job->chunks.size());  // result of each, a list of them unless reduce
+        vector<bool> here(job->chunks.size());
+        GC::Root rootmine {mine};
+        try {
+            for (size_t c = job->chunks.size(); c-- > 0;) {
+                if (job->chunks[c]->claimed.exchange(true)) continue;
+                size_t b {from + c * per}, e {min(b + per, xs.size())};
+                if (reduce) {
+                    mine[c] = xs[b];
+                    for (size_t i = b + 1; i < e; ++i) mine[c] = in.apply(f, List{mine[c], xs[i]});
+                }
+                else {
+                    List out;
+                    GC::Root rootout {out};
+                    for (size_t i = b; i < e; ++i) out.push_back(in.apply(f, List{xs[i]}));
+                    mine[c] = Cell{move(out)};
+                }
+                here[c] = true;
+            }
+        }
+        catch (...) {   // leave the rest to no one
+            for (auto& c : job->chunks) c->claimed = true;
+            throw;
+        }
+
+        for (size_t c = 0; c < job->chunks.size(); ++c) {
+            Task& chunk = *job->chunks[c];
+            if (!here[c]) {
+                wait(chunk);
+                if (!chunk.error.empty()) throw runtime_error(chunk.error);
+                List r = unpack(chunk.result);
+                res.insert(res.end(), make_move_iterator(r.begin()), make_move_iterator(r.end()));
+            }
+            else if (reduce) res.push_back(move(mine[c]));
+            else {
+                const List& r = mine[c].list();
+                res.insert(res.end(), r.begin(), r.end());
+            }
+        }
+        return res;
+    }
+}
+
+Package Parallel::pack(const Cell* b, const Cell* e, bool globals, Env* top) {
+    Package p;
+    Packer packer {p, globals, top};
+    for (auto c = b; c != e; ++c) {
+        Value v {packer.value(*c)};
+        p.values.push_back(move(v));
+    }
+    packer.finish();
+    return p;
+}
+
+List Parallel::unpack(const Package& p, Env* top) {
+    return Unpacker{p, top}.build();
+}
+
+Pool& Pool::get() {
+    static Pool pool {threads_wanted()};
+    return pool;
+}
+
+Pool::Pool(size_t n) {
+    for (size_t i = 0; i < n; ++i) queues.emplace_back(new Queue);
+    for (size_t i = 0; i < n; ++i) threads.emplace_back(&Pool::work, this, i);
+}
+
+Pool::~Pool() {
+    {
+        lock_guard<mutex> l {sleep};
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+void Pool::submit(function<void()> task) {
+    size_t q {inside(*this)? own : next++ % queues.size()};
+    {
+        lock_guard<mutex> l {queues[q]->m};
+        queues[q]->tasks.push_back(move(task));
+    }
+    {
+        lock_guard<mutex> l {sleep};
+        ++pending;
+    }
+    wake.notify_one();
+}
+
+bool Pool::take(size_t self, function<void()>& task) {
+    for (size_t i = 0; i < queues.size(); ++i) {
+        Queue& q = *queues[(self + i) % queues.size()];
+        lock_guard<mutex> l {q.m};
+        if (q.tasks.empty()) continue;
+        if (i == 0) { task = move(q.tasks.back()); q.tasks.pop_back(); }    // its own, newest first
+        else { task = move(q.tasks.front()); q.tasks.pop_front(); }         // stolen, oldest first
+        --pending;
+        return true;
+    }
+    return false;
+}
+
+bool Pool::run_one() {
+    function<void()> task;
+    if (!inside(*this) || !take(own, task)) return false;
+    task();
+    return true;
+}
+
+void Pool::work(size_t self) {
+    member = this;
+    own = self;
+    Interpreter clisp;
+    Interpreter::Use use {clisp};
+    while (true) {
+        function<void()> task;
+        if (take(self, task)) { task(); continue; }
+        unique_lock<mutex> l {sleep};
+        wake.wait(l, [this] { return stopping || pending > 0; });
+        if (stopping) return;
+    }
+}
+
+Cell Parallel::map(const Cell& f, const Cell& list) {
+    return spread(f, list, false);
+}
+
+Cell Parallel::reduce(const Cell& f, const Cell& start, const Cell& list) {
+    Cell fn {f}, acc {start};   // copied before spread applies anything, as in it
+    GC::Root rootfn {fn}, root {acc};
+    List parts = spread(fn, list, true);    // the prefix and each chunk folded, in order
+    GC::Root rootparts {parts};
+    Interpreter& in = Interpreter::current();
+    for (auto& p : parts) acc = in.apply(fn, List{acc, p});
+    return acc;
+}
+
+Cell Parallel::future(const Cell& thunk) {
+    Cell t {thunk};
+    GC::Root root {t};
+    if (t.kind != Kind::Proc) throw runtime_error("future expects a procedure");
+    Pool& pool = Pool::get();
+    if (pool.workers() == 0) return Interpreter::current().apply(t, List{});
+    auto task = make_shared<Task>();
+    task->work = pack(&t, &t + 1, true);
+    task->claimed = true;
+    pool.submit([task] {
+        Package out;
+        string error;
+        try {
+            Env* top {task_env()};
+            GC::Root roottop {top};
+            List thunk = unpack(task->work, top);
+            GC::Root root {thunk};
+            Cell res {Interpreter::current().apply(thunk[0], List{})};
+            GC::Root rootres {res};
+            out = pack(&res, &res + 1, false, top);
+        }
+        catch (exception& e) { error = e.what(); }
+        task->finish(move(out), move(error));
+    });
+    return Cell{new Lexer::Promise{task}};
+}
+
+Cell Parallel::touch(const Cell& x) {
+    if (x.kind != Kind::Promise) return x;
+    shared_ptr<Task> task {x.promise()->task};  // x may be on the VM's stack, which running other tasks can move
+    wait(*task);
+    if (!task->error.empty()) throw runtime_error(task->error);
+    List res = unpack(task->result);
+    return res[0];
+}
@@ -0,0 +1,105 @@
+#ifndef clispp_parallel
+#define clispp_parallel
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "lexer.h"
+#include "bytecode.h"
+
+// pmap, preduce, future and touch on a work-stealing pool of threads, each running an interpreter of its own.
+// cells are counted without atomics and belong to one interpreter, so nothing is shared between threads:
+// a procedure goes to a worker as a copy of its code, its environment and the global bindings its body names,
+// values go back and forth the same way. the thread asking for a pmap or preduce runs part of the list itself
+namespace Parallel {
+    using namespace std;
+    using Lexer::Cell;
+    using Lexer::Kind;
+    using Lexer::List;
+    using Environment::Env;
+
+    struct Value {  // a cell outside of any interpreter
+        Kind kind {Kind::End};
+        double num {0};
+        long long fixnum {0};
+        string name;    // of names, strings and keywords spelt out
+        bool interned {false};
+        bool boxed {false};     // lists and names hold a payload, keywords and empty Kind::Expr cells don't
+        vector<Value> items;
+        size_t proc {0};    // index into Package::procs
+        shared_ptr<Task> task;  // of a future
+    };
+
+    struct Package {    // values with the procedures, environments and code they reach, to be built again elsewhere
+        struct Proc { Value params, body; size_t env, code; };
+        struct Env { vector<pair<string, Value>> bindings; vector<Value> slots; size_t outer; };
+        struct Global { string name; int depth; };
+        struct Code {   // Bytecode::Code with names spelt out and constants as values
+            vector<Bytecode::Instr> instrs;
+            vector<Value> consts;
+            vector<string> names;
+            vector<Global> globals;
+            vector<vector<Bytecode::Address>> addrs;
+            vector<Bytecode::Layout> lets;
+            vector<pair<pair<Value, Value>, size_t>> procs;     // params and body of each template, with its code
+            Bytecode::Layout frame;
+            bool captures;
+        };
+        static constexpr size_t global {size_t(-1)};    // environment index of the global one, or no code
+
+        vector<Proc> procs;
+        vector<Env> envs;
+        vector<Code> codes;
+        vector<pair<string, Value>> globals;    // bindings of the global environment named by the procedures
+        vector<Value> values;
+    };
+
+    // from the interpreter in use, with the global bindings the procedures name if globals.
+    // top is taken for the global environment, e0 if nullptr
+    Package pack(const Cell* b, const Cell* e, bool globals, Env* top = nullptr);
+    // into the interpreter in use, top standing for the global environment packed from and given its bindings in p.
+    // a task unpacks into an environment of its own whose parent is e0, so they are gone once it ends
+    List unpack(const Package& p, Env* top = nullptr);
+
+    class Pool {    // threads taking tasks from their own queue last in first out, stealing others' first in first out
+    public:
+        static Pool& get();     // started on first use, one thread per core or CLISP_THREADS, counting the caller
+        size_t workers() const { return threads.size(); }
+        void submit(function<void()> task);
+        bool run_one();     // a task queued for the pool, if called from one of its threads
+        ~Pool();
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+    private:
+        explicit Pool(size_t n);
+        struct Queue {
+            mutex m;
+            deque<function<void()>> tasks;
+        };
+        bool take(size_t self, function<void()>& task);
+        void work(size_t self);
+
+        vector<unique_ptr<Queue>> queues;
+        vector<thread> threads;
+        mutex sleep;
+        condition_variable wake;
+        atomic<size_t> pending {0};
+        atomic<size_t> next {0};    // queue for the next task submitted from outside the pool
+        bool stopping {false};
+    };
+
+    constexpr long long inline_ns {1000000};    // lists whose work is estimated below this are mapped on the calling thread
+    constexpr long long chunk_ns {200000};      // least work handed to another thread at a time
+
+    Cell map(const Cell& f, const Cell& list);  // (pmap f list)
+    Cell reduce(const Cell& f, const Cell& start, const Cell& list);   // (preduce f start list), f associative
+    Cell future(const Cell& thunk);     // procedure of no arguments started on the pool
+    Cell touch(const Cell& x);  // value of a future once computed, anything else as is
+}
+#endif
@@ -1,140 +1,271 @@
 #include "parser_impl.h"
 #include "environment.h"
+#include "gc.h"
+#include "interpreter.h"
+#include "trace.h"
+#include "parallel.h"
 #include "error.h"
-#include <fstream>
 #include <sstream>
+#include <cmath>
+#include <climits>
+#include <pthread.h>
+#include <sys/resource.h>
 
 using namespace std;
 using namespace Lexer;
 using namespace Environment;
 
-template <typename T, typename Iter>
-const T& get(Iter p) {
-    return boost::get<T>(p->data);
-}
-
 List Parser::expr(bool getfirst) {   // returns an unevaluated expression from stream
+    Interpreter& in = Interpreter::current();
+    Cell_stream& cs = in.cs;
+    size_t quotes {0};  // in front of the expression
+    while (true) {
+        while (getfirst && cs.get().kind == Kind::Comment) cs.ignoreln();   // eat either first ( or ;
+        if (cs.current().kind != Kind::Quote) break;
+        ++quotes;
+        getfirst = true;
+    }
+
     List res;
-    while (getfirst && cs.get().kind == Kind::Comment) cs.ignoreln();   // eat either first ( or ;
-    if (cs.current().kind != Kind::Lp) {    // not a call, doesn't start with (
-        if (cs.current().kind == Kind::End) return res;
-        res.push_back(cs.current()); 
-        if (cs.current().kind == Kind::Quote) {
-            List quote(expr(true));
-            if (quote.size() == 1) res.push_back(quote[0]); 
-            else res.push_back(quote); 
+    if (cs.current().kind == Kind::Lp) {
+        // without recursion, the elements of every open list are kept in one arena, where each list
+        // starts at an index on the open stack, and moved out into a list of the exact size once closed
+        List& arena = in.parsing;
+        vector<size_t> open {0};
+        arena.clear();
+        while (!open.empty()) {
+            switch (cs.get().kind) {
+                case Kind::Lp: open.push_back(arena.size()); break;    // start of another expression
+                case Kind::End:     // ends an unclosed outermost list like )
+                    if (open.size() > 1) throw runtime_error("')' expected");
+                case Kind::Rp: {
+                    List l {make_move_iterator(arena.begin() + open.back()), make_move_iterator(arena.end())};
+                    arena.resize(open.back());
+                    open.pop_back();
+                    if (open.empty()) res = move(l);
+                    else arena.push_back(move(l));
+                    break;
+                }
+                case Kind::Comment: cs.ignoreln(); break;
+                default: arena.push_back(cs.current()); break;  // anything else just push back as is
+            }
         }
-        return res;   
-    } 
-    // expr ... (expr) ...) starts with first lp eaten
-    while (true) {
-        cs.get();
-        switch (cs.current().kind) {
-            case Kind::Lp: {    // start of another expression
-                res.push_back(expr(false));  // construct with List, kind is expr and data stored in lstval
-                // after geting in an ( expression ' ' <-- expecting rp
-                if (cs.current().kind != Kind::Rp) throw runtime_error("')' expected");
+    }
+    else if (cs.current().kind != Kind::End) res.push_back(cs.current());    // not a call, doesn't start with (
+
+    while (quotes--) {  // a quoted single cell is kept as is, anything else as a list
+        Cell quoted {res.size() == 1? move(res[0]) : Cell{move(res)}};
+        res = List{Kind::Quote, move(quoted)};
+    }
+    return res;
+}
+
+namespace {
+    size_t stack_budget() {     // native stack of this thread eval may use, leaving room for what its callees need
+        size_t size {0};
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+            void* addr;
+            pthread_attr_getstack(&attr, &addr, &size);
+            pthread_attr_destroy(&attr);
+        }
+        rlimit limit;
+        if (size == 0 && (getrlimit(RLIMIT_STACK, &limit) || limit.rlim_cur == RLIM_INFINITY)) return size_t{1} << 30;
+        if (size == 0) size = limit.rlim_cur;
+        return size > (1 << 20)? size - (1 << 19) : size / 2;
+    }
+
+    struct Nested {     // fails cleanly instead of overflowing the native stack
+        Nested() : in{Interpreter::current()} {
+            static thread_local const size_t budget {stack_budget()};
+            char here;
+            if (in.depth == 0) in.base = &here;
+            else if (in.depth == in.max_depth || size_t(in.base - &here) > budget) throw runtime_error("Recursion too deep");
+            ++in.depth;
+        }
+        ~Nested() { --in.depth; }
+        Interpreter& in;
+    };
+
+    Proc* procedure(const Cell& params, const Cell& body, Env* env) {  // introduce onto heap
+        params.seq();   // both have to be lists
+        body.seq();
+        return GC::proc(params, body, env);
+    }
+
+    Cell profile(const Cell* b, const Cell* e, Env* env) {  // (profile expr)
+        if (b == e) throw runtime_error("Profile expects an expression");
+        Interpreter& in = Interpreter::current();
+        in.profiler.start();
+        try {
+            Cell res {Parser::eval(b, e, env)};
+            in.profiler.stop(*in.outstream);
+            return res;
+        }
+        catch (...) {
+            in.profiler.stop(*in.outstream);
+            throw;
+        }
+    }
+
+    List operands(const Cell* p, const Cell* e, Env* env) {    // of a call, as many evaluated locally as possible
+        List args;
+        GC::Root root {args};
+        for (; p != e; ++p) {   // names are looked up, so procedures among them are passed rather than applied
+            if (p->numeric()) args.push_back(*p);
+            else if (p->kind == Kind::Quote) args.push_back(*++p);
+            else if (p->kind == Kind::Name) args.push_back(env->lookup(p->sym()));
+            else {
+                List addargs = Parser::evlist(p, e, env);   // evlist any remaining expressions
+                if (args.empty()) args = move(addargs);
+                else args.insert(args.end(), make_move_iterator(addargs.begin()), make_move_iterator(addargs.end()));
                 break;
             }
-            case Kind::End: 
-            case Kind::Rp: return res;  // for initial expr call, all nested expr calls will exit through first case
-            case Kind::Comment: cs.ignoreln(); break; 
-            default: res.push_back(cs.current()); break;   // anything else just push back as is
         }
+        return args;
+    }
+
+    Cell spawn(const Cell* b, const Cell* e, Env* env) {    // (future expr), expr evaluated on the pool
+        if (b == e) throw runtime_error("Future expects an expression");
+        return Parallel::future(Cell{procedure(Cell{List{}}, Cell{List(b, e)}, env)});
+    }
+
+    // whether evaluating a sublist as the last thing in eval gives the same result as evlist would,
+    // (lists headed by a procedure, let or begin) so it can be done in tail position
+    bool tail_form(const List& l, Env* env) {
+        if (l.empty()) return false;
+        if (l[0].kind == Kind::Let || l[0].kind == Kind::Begin) return true;
+        if (l[0].kind != Kind::Name) return false;
+        Cell* x {env->find(l[0].sym())};
+        return x && x->kind == Kind::Proc;
     }
 }
 
 Cell Parser::eval(const List& expr, Env* env) {
-    for (auto p = expr.begin(); p != expr.end(); ++p) {
+    return eval(expr.data(), expr.data() + expr.size(), env);
+}
+
+Cell Parser::eval(const Cell& x, Env* env) {
+    return eval(&x, &x + 1, env);
+}
+
+Cell Parser::eval(const Cell* b, const Cell* e, Env* env) {
+    Nested nested;
+    Profile::Call call {nested.in.profiler};    // the procedure called in tail position
+    Cell next;      // holds the list b and e point into after a call in tail position
+    Cell callee;
+    GC::Root rootnext {next}, rootcallee {callee}, rootenv {env};
+tailcall:   // calls in tail position continue here instead of nesting another eval
+    if (Trace::enabled) Trace::eval(b, e, nested.in.depth);
+    for (auto p = b; p != e; ++p) {
         switch (p->kind) {
             case Kind::Include: 
-                cs.set_input(new ifstream{get<string>(++p)}); 
+                nested.in.cs.open((++p)->name()); 
                 return {Kind::Include};
-            case Kind::Number: return *p;
+            case Kind::Number: case Kind::Integer: return *p;
             // return next expression unevaluated, (quote expr)
             case Kind::Quote: 
-                if (p + 1 == expr.end()) throw runtime_error("Quote expects 1 arg");
+                if (p + 1 == e) throw runtime_error("Quote expects 1 arg");
                 return *++p;  
             case Kind::Begin:       // (begin a b c d ... return)
-                evlist({++p, expr.end() - 1}, env);
-                return eval({expr.back()}, env);    
+                evlist(p + 1, e - 1, env);
+                b = e - 1;
+                goto tailcall;
             case Kind::Lambda: {    // (lambda (params) (body))
-                if (p + 2 >= expr.end()) throw runtime_error("Malformed lambda expression");
-                auto params = get<List>(++p);
-                auto body = get<List>(++p);
-                procs.push_back({params, body, env});    // introduce onto heap
-                return {&procs.back()};
+                if (p + 2 >= e) throw runtime_error("Malformed lambda expression");
+                const Cell& params = *++p;
+                return {procedure(params, *++p, env)};
             }
+            case Kind::Profile: return profile(p + 1, e, env);
+            case Kind::Future: return spawn(p + 1, e, env);
             // introduce cell to environment (define name expr)
             case Kind::Define: {
-                if (p + 2 >= expr.end()) throw runtime_error("Malformed define expression");
+                if (p + 2 >= e) throw runtime_error("Malformed define expression");
                 auto np = ++p;    // cell to be defined
                 if (np->kind == Kind::Name) 
-                    return (*env)[get<string>(np)] = eval({++p, expr.end()}, env); 
+                    return (*env)[np->sym()] = eval(np + 1, e, env); 
                 else if (np->kind == Kind::Expr) {   // (syntactic sugar for defining functions (define (func args) (body))
-                    auto declaration = get<List>(np);
-                    string name = get<string>(declaration.begin());
-                    auto params = List{declaration.begin() + 1, declaration.end()};
-                    auto body = get<List>(++p);
-                    procs.push_back({params, body, env});
-                    return (*env)[name] = {&procs.back()};
+                    const List& declaration = np->list();
+                    const Symbol* name {declaration[0].sym()};
+                    return (*env)[name] = {procedure(tail(*np), *++p, env)};
                 }
                 else throw runtime_error("Unfamiliar form to define");
             }
             // (... (expr) ...) parentheses encloses expression (as parsed by expr())
             case Kind::Expr: { 
-                auto res = evlist(get<List>(p), env); 
-                if (res.size() == 1) return {res[0]}; // single element
-                return {res};
+                if (tail_form(p->list(), env)) {
+                    next = *p;
+                    b = next.list().data();
+                    e = b + next.list().size();
+                    goto tailcall;
+                }
+                auto res = evlist(p->list(), env); 
+                if (res.size() == 1) return move(res[0]); // single element
+                return {move(res)};
             }
             // (let (definitions...) body) block structure
             case Kind::Let: {
-                if (p + 2 >= expr.end()) throw runtime_error("Let expects a list of definitions and a body");
-                auto localvars = get<List>(++p); // ((name val) (name val) ...)
-                Env localenv {env};
+                if (p + 2 >= e) throw runtime_error("Let expects a list of definitions and a body");
+                const List& localvars = (++p)->list(); // ((name val) (name val) ...)
+                Env* localenv {GC::env(env)};  // on the heap since the body is evaluated in tail position
+                GC::Root root {localenv};
                 for (auto& pair : localvars)    // add to local env
-                    localenv[boost::get<string>((boost::get<List>(pair.data)[0]).data)] = eval({boost::get<List>(pair.data)[1]}, env);
+                    (*localenv)[pair.list()[0].sym()] = eval(pair.list()[1], env);
                 // evaluate rest of expression inside new env
+                env = localenv;
+                rootenv.reset(env);
                 if ((++p)->kind == Kind::Expr) {
-                    auto body = get<List>(p);
-                    return eval(body, &localenv);   // local env is temporary, no need to allocate on heap
+                    next = *p;
+                    b = next.list().data();
+                    e = b + next.list().size();
                 }
-                return eval({*p}, &localenv);   
+                else { b = p; e = p + 1; }
+                goto tailcall;
             }
             // (cond ((pred) (expr)) ((pred) (expr)) ...(else expr)) expect list of pred-expr pairs
             case Kind::Cond: {
-                while (++p != expr.end()) {
-                    const List& clause = get<List>(p);
+                while (++p != e) {
+                    const List& clause = p->list();
                     if (clause[0].kind == Kind::Else) {
-                        if (p + 1 == expr.end()) return eval({clause[1]}, env);
+                        if (p + 1 == e) { b = &clause[1]; e = b + 1; goto tailcall; }
                         else throw runtime_error("Else clause not at end of condition");
                     }
-                    if (eval({clause[0]}, env)) return eval({clause.begin() + 1, clause.end()}, env);
+                    if (eval(clause[0], env)) {
+                        b = clause.data() + 1;
+                        e = clause.data() + clause.size();
+                        goto tailcall;
+                    }
                 }
             }
             // primitive procedures
             case Kind::Add: case Kind::Sub: case Kind::Mul: case Kind::Div: case Kind::Less: case Kind::Greater: case Kind::Equal: 
             case Kind::Cat: case Kind::Cons: case Kind::Car: case Kind::Cdr: case Kind::List: case Kind::And: case Kind::Or: case Kind::Not: 
-            case Kind::Empty: {
-                if (p + 1 == expr.end()) throw runtime_error("Primitives take at least one argument");
-                auto prim = *p;
-                return apply_prim(prim, evlist({++p, expr.end()}, env));
+            case Kind::Empty: case Kind::GcStats: case Kind::AllocStats: case Kind::Modulo: case Kind::Quotient:
+            case Kind::Touch: case Kind::Pmap: case Kind::Preduce: {
+                if (p + 1 == e && !nullary(p->kind)) throw runtime_error("Primitives take at least one argument");
+                Primitive run {primitive(p->kind)};
+                List args = takes_procedure(p->kind)? operands(p + 1, e, env) : evlist(p + 1, e, env);
+                Profile::Call prim {nested.in.profiler, p->kind};
+                Cell res {run(args.data(), args.data() + args.size())};
+                if (Trace::enabled) Trace::prim(p->kind, args.data(), args.data() + args.size(), res);
+                return res;
             }
             case Kind::Name: {  // lexer cannot distinguish between varname and procname, have to evaluate against environment
-                Cell x = env->lookup(get<string>(p));
+                Cell x = env->lookup(p->sym());
                 if (x.kind != Kind::Proc) return x;
-                List args;  // user defined proc
-                while (++p != expr.end()) {  // evaluate as many arguments locally as possible
-                    if (p->kind == Kind::Number) args.push_back(*p);
-                    else if (p->kind == Kind::Quote) args.push_back(*++p);
-                    else if (p->kind == Kind::Name) args.push_back(env->lookup(get<string>(p)));
-                    else {
-                        List addargs = evlist({p, expr.end()}, env); // evlist any remaining expressions
-                        args.insert(args.end(), addargs.begin(), addargs.end());
-                        break;
-                    }
-                }
-                return apply(x, args);    
+                GC::Root rootx {x};
+                List args = operands(p + 1, e, env);    // user defined proc
+                GC::Root rootargs {args};
+                callee = move(x);   // keeps the body alive
+                const Proc& proc = *callee.proc();
+                call.enter(&proc);
+                if (Trace::enabled) Trace::apply(proc, args);
+                env = bind(proc.params.list(), move(args), proc.env);
+                rootenv.reset(env);
+                const List& body = proc.body.list();
+                b = body.data();
+                e = b + body.size();
+                goto tailcall;
             }
             default: throw runtime_error("Unmatched cell in eval");
         }
@@ -143,106 +274,106 @@ Cell Parser::eval(const List& expr, Env* env) {
 }
 
 List Parser::evlist(const List& expr, Env* env) {
+    return evlist(expr.data(), expr.data() + expr.size(), env);
+}
+
+List Parser::evlist(const Cell* b, const Cell* e, Env* env) {
     List res;   // instead of returning right away, push back into res then return res
-    for (auto p = expr.begin(); p != expr.end(); ++p) {
+    GC::Root root {res};
+    if (Trace::enabled) Trace::evlist(b, e, Interpreter::current().depth);
+    for (auto p = b; p != e; ++p) {
         switch (p->kind) {
             case Kind::Include: 
-                cs.set_input(new ifstream{get<string>(++p)}); 
+                Interpreter::current().cs.open((++p)->name()); 
                 return {Kind::Include};
-            case Kind::Number: res.push_back(*p); break;
+            case Kind::Number: case Kind::Integer: res.push_back(*p); break;
             // return next expression unevaluated, (quote expr)
             case Kind::Quote: 
-                if (p + 1 == expr.end()) throw runtime_error("Quote expects 1 arg");
+                if (p + 1 == e) throw runtime_error("Quote expects 1 arg");
                 res.push_back(*++p); break;  
             case Kind::Begin:       // (begin a b c d ... return)
-                evlist({++p, expr.end() - 1}, env);
-                res.push_back(eval({expr.back()}, env));
+                evlist(p + 1, e - 1, env);
+                res.push_back(eval(e[-1], env));
+                return res;
+            case Kind::Profile:
+                res.push_back(profile(p + 1, e, env));
+                return res;
+            case Kind::Future:
+                res.push_back(spawn(p + 1, e, env));
                 return res;
             case Kind::Lambda: {    // (lambda (params) (body))
-                if (p + 2 >= expr.end()) throw runtime_error("Malformed lambda expression");
-                auto params = get<List>(++p);
-                auto body = get<List>(++p);
-                procs.push_back({params, body, env});    // introduce onto heap
-                res.push_back({&procs.back()});
+                if (p + 2 >= e) throw runtime_error("Malformed lambda expression");
+                const Cell& params = *++p;
+                res.push_back({procedure(params, *++p, env)});
                 break;
             }
             // introduce cell to environment (define name expr)
             case Kind::Define: {
-                if (p + 2 >= expr.end()) throw runtime_error("Malformed define expression");
+                if (p + 2 >= e) throw runtime_error("Malformed define expression");
                 auto np = ++p;    // cell to be defined
                 if (np->kind == Kind::Name) {
-                    res.push_back((*env)[get<string>(np)] = eval({++p, expr.end()}, env)); 
+                    res.push_back((*env)[np->sym()] = eval(np + 1, e, env)); 
                     return res;
                 }
                 else if (np->kind == Kind::Expr) {   // (syntactic sugar for defining functions (define (func args) (body))
-                    auto declaration = get<List>(np);
-                    string name = get<string>(declaration.begin());
-                    auto params = List{declaration.begin() + 1, declaration.end()};
-                    auto body = get<List>(++p);
-                    procs.push_back({params, body, env});
-                    res.push_back((*env)[name] = {&procs.back()});
+                    const List& declaration = np->list();
+                    const Symbol* name {declaration[0].sym()};
+                    res.push_back((*env)[name] = {procedure(tail(*np), *++p, env)});
                     return res;
                 }
                 else throw runtime_error("Unfamiliar form to define");
             }
             // (... (expr) ...) parentheses encloses expression (as parsed by expr())
             case Kind::Expr: {
-                auto r = evlist(get<List>(p), env); 
-                if (r.size() == 1) res.push_back({r[0]}); // single element result
-                else res.push_back({r});
+                auto r = evlist(p->list(), env); 
+                if (r.size() == 1) res.push_back(move(r[0])); // single element result
+                else res.push_back({move(r)});
                 break;
             }
             // (let (definitions...) body) block structure
             case Kind::Let: {
-                if (p + 2 >= expr.end()) throw runtime_error("Let expects a list of definitions and a body");
-                auto localvars = get<List>(++p); // ((name val) (name val) ...)
+                if (p + 2 >= e) throw runtime_error("Let expects a list of definitions and a body");
+                const List& localvars = (++p)->list(); // ((name val) (name val) ...)
                 Env localenv {env};
+                GC::Root rootenv {&localenv};
                 for (auto& pair : localvars) // add to local env
-                    localenv[boost::get<string>((boost::get<List>(pair.data)[0]).data)] = eval({boost::get<List>(pair.data)[1]}, env);
+                    localenv[pair.list()[0].sym()] = eval(pair.list()[1], env);
                 // evaluate rest of expression inside new env
-                if ((++p)->kind == Kind::Expr) {
-                    auto body = get<List>(p);
-                    res.push_back(eval(body, &localenv));   
-                }
-                else res.push_back(eval({*p}, &localenv));
+                if ((++p)->kind == Kind::Expr) res.push_back(eval(p->list(), &localenv));
+                else res.push_back(eval(*p, &localenv));
                 return res;   
             }
             // (cond ((pred) (expr)) ((pred) (expr)) ...) expect list of pred-expr pairs
             case Kind::Cond: {
-                while (++p != expr.end()) {
-                    const List& clause = get<List>(p);
+                while (++p != e) {
+                    const List& clause = p->list();
                     if (clause[0].kind == Kind::Else) {
-                        if (p + 1 == expr.end()) { res.push_back(eval({clause[1]}, env)); return res; }
+                        if (p + 1 == e) { res.push_back(eval(clause[1], env)); return res; }
                         else throw runtime_error("Else clause not at end of condition");
                     }
-                    if (eval({clause[0]}, env)) { res.push_back(eval({clause[1]}, env)); break; }
+                    if (eval(clause[0], env)) { res.push_back(eval(clause[1], env)); break; }
                 }
                 break;
             }
             // primitive procedures
             case Kind::Add: case Kind::Sub: case Kind::Mul: case Kind::Div: case Kind::Less: case Kind::Greater: case Kind::Equal: 
             case Kind::Cat: case Kind::Cons: case Kind::Car: case Kind::Cdr: case Kind::List: case Kind::And: case Kind::Or: case Kind::Not:
-            case Kind::Empty: {
-                if (p + 1 == expr.end()) throw runtime_error("Primitives take at least one argument");
-                auto prim = *p;
-                res.push_back(apply_prim(prim, evlist({++p, expr.end()}, env)));
+            case Kind::Empty: case Kind::GcStats: case Kind::AllocStats: case Kind::Modulo: case Kind::Quotient:
+            case Kind::Touch: case Kind::Pmap: case Kind::Preduce: {
+                if (p + 1 == e && !nullary(p->kind)) throw runtime_error("Primitives take at least one argument");
+                Primitive run {primitive(p->kind)};
+                List args = takes_procedure(p->kind)? operands(p + 1, e, env) : evlist(p + 1, e, env);
+                Profile::Call prim {Interpreter::current().profiler, p->kind};
+                res.push_back(run(args.data(), args.data() + args.size()));
+                if (Trace::enabled) Trace::prim(p->kind, args.data(), args.data() + args.size(), res.back());
                 return res; // finished reading entire expression
             }
             case Kind::Name: {  // lexer cannot distinguish between varname and procname, have to evaluate against environment
-                Cell x = env->lookup(get<string>(p));
-                if (x.kind != Kind::Proc) { res.push_back(x); break; }
-                List args;
-                while (++p != expr.end()) {  // evaluate as many arguments locally as possible
-                    if (p->kind == Kind::Number) args.push_back(*p);
-                    else if (p->kind == Kind::Quote) args.push_back(*++p);
-                    else if (p->kind == Kind::Name) args.push_back(env->lookup(get<string>(p)));
-                    else {
-                        List addargs = evlist({p, expr.end()}, env); // evlist any remaining expressions
-                        args.insert(args.end(), addargs.begin(), addargs.end());
-                        break;
-                    }
-                }
-                res.push_back(apply(x, args)); return res;         // user defined proc
+                Cell x = env->lookup(p->sym());
+                if (x.kind != Kind::Proc) { res.push_back(move(x)); break; }
+                GC::Root rootx {x};
+                List args = operands(p + 1, e, env);
+                res.push_back(apply(x, move(args))); return res;   // user defined proc
             }
             default: throw runtime_error("Unmatched in evlist"); 
         }
@@ -250,108 +381,139 @@ List Parser::evlist(const List& expr, Env* env) {
     return res;
 }
 
-Cell Parser::apply(const Cell& c, const List& args) {  // expect fully evaluated args
-    const Proc& proc = *boost::get<Proc*>(c.data);
-    Env* newenv = Parser::bind(proc.params, args, proc.env);
-    return eval(proc.body, newenv);
+Cell Parser::apply(const Cell& c, List args) {  // expect fully evaluated args
+    const Proc& proc = *c.proc();
+    Profile::Call call {Interpreter::current().profiler, &proc};
+    if (Trace::enabled) Trace::apply(proc, args);
+    GC::Root rootargs {args};
+    Env* newenv = Parser::bind(proc.params.list(), move(args), proc.env);
+    GC::Root root {newenv};
+    return eval(proc.body.list(), newenv);
 }
 
-Env* Parser::bind(const List& params, const List& args, Env* env) {
-    Env newenv {env};
+Env* Parser::bind(const List& params, List&& args, Env* env) {  // args are moved into the frame
     if (params.size() != args.size()) { 
         stringstream msg; msg << "provided args : " << args.size() << " expected: " << params.size();
         throw runtime_error(msg.str());
     }
+    Env* newenv = GC::env(env);  // store on the heap to allow reference and pointer
     auto q = args.begin();
     for (auto p = params.begin(); p != params.end(); ++p, ++q)
-        newenv[get<string>(p)] = *q;
-
-    envs.push_back(newenv);  // store on the heap to allow reference and pointer
-    return &envs.back();
+        (*newenv)[p->sym()] = move(*q);
+    return newenv;
 }
 
-// primitive procedures
-Cell Parser::apply_prim(const Cell& prim, const List& args) {
-    switch (prim.kind) {
-        case Kind::Add: {   // more efficient to separate addition and concatenation
-            double res {get<double>(args.begin())};
-            for (auto p = args.begin() + 1; p != args.end(); ++p)
-                res += get<double>(p);
-            return {res};
-        }
-        case Kind::Cat: {   // (cat 'str 'str ...)
-            string res {get<string>(args.begin())};
-            for (auto p = args.begin() + 1; p != args.end(); ++p)
-                res += get<string>(p);
-            return {res};
-        }
-        case Kind::Sub: {
-            double res {get<double>(args.begin())};
-            for (auto p = args.begin() + 1; p != args.end(); ++p)
-                res -= get<double>(p);
-            return {res};
-        }
-        case Kind::Mul: {
-            double res {get<double>(args.begin())};
-            for (auto p = args.begin() + 1; p != args.end(); ++p)
-                res *= get<double>(p);
-            return {res};
-        }
-        case Kind::Div: {
-            double res {get<double>(args.begin())};
-            for (auto p = args.begin() + 1; p != args.end(); ++p)
-                res /= get<double>(p);  // uncheckd divide by 0
-            return {res};
-        }
-        case Kind::Less: {
-            if (args[0].kind == Kind::Number)
-                return Cell{boost::apply_visitor(less_visitor(get<double>(args.begin())), args[1].data)};
-            return Cell{boost::apply_visitor(less_visitor(get<string>(args.begin())), args[1].data)};
-        }
-        case Kind::Equal: {
-            if (args[0].kind == Kind::Number)
-                return Cell{boost::apply_visitor(equal_visitor(get<double>(args.begin())), args[1].data)};
-            return Cell{boost::apply_visitor(equal_visitor(get<string>(args.begin())), args[1].data)};
-        }
-        case Kind::Empty: {
-            if (args[0].kind == Kind::Expr)
-                return Cell{get<List>(args.begin()).size() == 0};
-            return Cell{Kind::False};
-        }
-        case Kind::Greater: {   // for the sake of efficiency not implemented using !< && !=
-            if (args[1].kind == Kind::Number)   // a > b == b < a, just use less
-                return Cell{boost::apply_visitor(less_visitor(get<double>(args.begin() + 1)), args[0].data)};
-            return Cell{boost::apply_visitor(less_visitor(get<string>(args.begin() + 1)), args[0].data)};
-        }
-        case Kind::And: {
-            for (auto& clause : args)
-                if(clause.kind == Kind::False) return clause;
-            return Cell{Kind::True};
-        }
-        case Kind::Or: {
-            for (auto& clause : args)
-                if(clause.kind == Kind::True) return clause;
-            return Cell{Kind::False};
-        }
-        case Kind::Not: return Cell{args[0].kind == Kind::False? Kind::True : Kind::False};  // only expect 1 argument
-        case Kind::List: return args;
-        case Kind::Cons: {
-			List res {args[0]};
-			if (args[1].kind == Kind::Expr) res.insert(res.end(), boost::get<List>(args[1].data).begin(), boost::get<List>(args[1].data).end());
-			else res.push_back(args[1]);
-			return res; // return List of the 
-		}
-        case Kind::Car: {
-            if (args[0].kind != Kind::Expr) return args[0];
-            return boost::get<List>(args[0].data)[0]; // args is a list of one cell which holds a list itself
+// primitive procedures, each given its evaluated arguments from a to e
+namespace {
+    using Parser::Primitive;
+
+    Cell add(const Cell* a, const Cell* e) { return Parser::fold(a, e, Parser::Plus{}); }  // more efficient to separate addition and concatenation
+    Cell cat(const Cell* a, const Cell* e) {    // (cat 'str 'str ...)
+        string res {a->name()};
+        while (++a != e) res += a->name();
+        return {res};
+    }
+    Cell sub(const Cell* a, const Cell* e) { return Parser::fold(a, e, Parser::Minus{}); }
+    Cell mul(const Cell* a, const Cell* e) { return Parser::fold(a, e, Parser::Times{}); }
+    Cell divide(const Cell* a, const Cell* e) { return Parser::fold(a, e, Parser::Over{}); }
+    void arity(const Cell* a, const Cell* e, ptrdiff_t n) {   // as for a procedure given the wrong number of args
+        if (e - a == n) return;
+        stringstream msg; msg << "provided args : " << e - a << " expected: " << n;
+        throw runtime_error(msg.str());
+    }
+    Cell modulo(const Cell* a, const Cell* e) {     // takes the sign of the divisor
+        arity(a, e, 2);
+        if (a[0].kind == Kind::Integer && a[1].kind == Kind::Integer) {
+            long long x {a[0].fixnum()}, y {a[1].fixnum()};
+            if (y == 0) throw runtime_error("Division by zero");
+            long long r {y == -1? 0 : x % y};
+            return Cell{r != 0 && (r < 0) != (y < 0)? r + y : r};
         }
-        case Kind::Cdr: { 
-            if (args[0].kind != Kind::Expr) return {List {}};
-            auto list = boost::get<List>(args[0].data); 
-            if (list.size() == 1) return {List {}};
-            else if (list.size() == 2) return list[1];
-            return {List{list.begin() + 1, list.end()}}; 
+        double y {a[1].num()};
+        double r {fmod(a[0].num(), y)};
+        return Cell{r != 0 && (r < 0) != (y < 0)? r + y : r};
+    }
+    Cell quotient(const Cell* a, const Cell* e) {   // truncated towards zero
+        arity(a, e, 2);
+        if (a[0].kind == Kind::Integer && a[1].kind == Kind::Integer) {
+            long long x {a[0].fixnum()}, y {a[1].fixnum()};
+            if (y == 0) throw runtime_error("Division by zero");
+            if (y == -1 && x == LLONG_MIN) return Cell{-double(x)};
+            return Cell{x / y};
         }
-        default: throw runtime_error("Mismatoh in apply_prim");
+        return Cell{trunc(a[0].num() / a[1].num())};
+    }
+    Cell less(const Cell* a, const Cell*) { return Cell{a[0] < a[1]}; }
+    Cell equal(const Cell* a, const Cell*) { return Cell{a[0] == a[1]}; }
+    Cell greater(const Cell* a, const Cell*) { return Cell{a[1] < a[0]}; }   // a > b == b < a, not implemented using !< && !=
+    Cell empty(const Cell* a, const Cell*) {
+        if (a->kind == Kind::Expr) return Cell{length(*a) == 0};
+        return Cell{Kind::False};
+    }
+    Cell all(const Cell* a, const Cell* e) {
+        for (; a != e; ++a)
+            if (a->kind == Kind::False) return *a;
+        return Cell{Kind::True};
+    }
+    Cell any(const Cell* a, const Cell* e) {
+        for (; a != e; ++a)
+            if (a->kind == Kind::True) return *a;
+        return Cell{Kind::False};
+    }
+    Cell negate(const Cell* a, const Cell*) { return Cell{a->kind == Kind::False? Kind::True : Kind::False}; }  // only expect 1 argument
+    Cell enlist(const Cell* a, const Cell* e) { return List(a, e); }
+    Cell construct(const Cell* a, const Cell*) {
+        if (a[1].kind == Kind::Expr) return cons(a[0], a[1]);    // shares the elements of a[1]
+        return List{a[0], a[1]};
+    }
+    Cell gc_stats(const Cell*, const Cell*) { return GC::report(); }
+    Cell alloc_stats(const Cell*, const Cell*) { return Alloc::report(); }
+    Cell car(const Cell* a, const Cell*) {
+        if (a->kind != Kind::Expr) return *a;
+        return first(*a);   // the one argument holds a list itself
+    }
+    Cell cdr(const Cell* a, const Cell*) {
+        if (a->kind != Kind::Expr) return {List {}};
+        size_t n {length(*a)};
+        if (n == 1) return {List {}};
+        else if (n == 2) return first(tail(*a));
+        return tail(*a);
     }
+    Cell spawn(const Cell* a, const Cell*) { return Parallel::future(a[0]); }    // of the procedure compiled from (future expr)
+    Cell touch(const Cell* a, const Cell*) { return Parallel::touch(a[0]); }
+    Cell pmap(const Cell* a, const Cell* e) {   // (pmap f list)
+        if (e - a != 2) throw runtime_error("pmap expects a procedure and a list");
+        return Parallel::map(a[0], a[1]);
+    }
+    Cell preduce(const Cell* a, const Cell* e) {    // (preduce f start list)
+        if (e - a != 3) throw runtime_error("preduce expects a procedure, a start and a list");
+        return Parallel::reduce(a[0], a[1], a[2]);
+    }
+    Cell unknown(const Cell*, const Cell*) { throw runtime_error("Mismatoh in apply_prim"); }
+
+    struct Primitives {     // executor of each kind, looked up instead of switching on every call
+        Primitive of[128];
+        Primitives() {
+            for (auto& p : of) p = unknown;
+            set(Kind::Add, add); set(Kind::Cat, cat); set(Kind::Sub, sub); set(Kind::Mul, mul); set(Kind::Div, divide);
+            set(Kind::Less, less); set(Kind::Equal, equal); set(Kind::Greater, greater); set(Kind::Empty, empty);
+            set(Kind::And, all); set(Kind::Or, any); set(Kind::Not, negate); set(Kind::List, enlist);
+            set(Kind::Modulo, modulo); set(Kind::Quotient, quotient); set(Kind::Cons, construct); set(Kind::GcStats, gc_stats); set(Kind::AllocStats, alloc_stats); set(Kind::Car, car); set(Kind::Cdr, cdr);
+            set(Kind::Future, spawn); set(Kind::Touch, touch); set(Kind::Pmap, pmap); set(Kind::Preduce, preduce);
+        }
+        void set(Kind k, Primitive p) { of[static_cast<unsigned char>(k)] = p; }
+    };
+    const Primitives primitives;
+}
+
+Primitive Parser::primitive(Kind k) {
+    unsigned char i = static_cast<unsigned char>(k);
+    return i < 128? primitives.of[i] : unknown;
+}
+
+Cell Parser::apply_prim(const Cell& prim, const List& args) {
+    Profile::Call call {Interpreter::current().profiler, prim.kind};
+    Cell res {primitive(prim.kind)(args.data(), args.data() + args.size())};
+    if (Trace::enabled) Trace::prim(prim.kind, args.data(), args.data() + args.size(), res);
+    return res;
 }
@@ -2,12 +2,14 @@
 #define lispcpp_parser
 #include "lexer.h"
 #include "environment.h"
-namespace Parser {
+namespace Parser {   // working on the interpreter in use on this thread
     using namespace Lexer;
     using namespace Environment;
 
     List expr(bool getfirst);    // parses an expression without evaluating it, returning it as the lstval inside a cell
     Cell eval(const List& expr, Env* env);     // delayed evaluation of expression given back by expr()
-    Cell apply(const Cell& proc, const List& args);           // applies a procedure to return a value
+    Cell eval(const Cell* b, const Cell* e, Env* env);  // part of an expression, without copying it into a List
+    Cell eval(const Cell& x, Env* env);        // a single cell as if it were the whole expression
+    Cell apply(const Cell& proc, List args);     // applies a procedure to return a value, moving args into its frame
 }
 #endif
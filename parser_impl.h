@@ -1,10 +1,54 @@
 #ifndef bc_parser_impl
 #define bc_parser_impl
+#include <climits>
 #include "parser.h"
 
 namespace Parser {  // implementation interface
     List evlist(const List& expr, Env* env);
-    Env* bind(const List& params, const List& args, Env* env);
+    List evlist(const Cell* b, const Cell* e, Env* env);
+    Env* bind(const List& params, List&& args, Env* env);
+    using Primitive = Cell (*)(const Cell* args, const Cell* end);  // takes the evaluated arguments in place
+    Primitive primitive(Kind k);    // procedure carrying out primitive k, found once per call site
     Cell apply_prim(const Cell& prim, const List& args);
+    inline bool nullary(Kind k) { return k == Kind::GcStats || k == Kind::AllocStats; }    // primitives taking no arguments
+    inline bool takes_procedure(Kind k) { return k == Kind::Pmap || k == Kind::Preduce; }  // named first, as for a call, not applied
+
+    // steps of + - * /, the exact one false if its result is not an integer that fits
+    struct Plus {
+        bool operator()(long long x, long long y, long long& r) const { return !__builtin_add_overflow(x, y, &r); }
+        double operator()(double x, double y) const { return x + y; }
+    };
+    struct Minus {
+        bool operator()(long long x, long long y, long long& r) const { return !__builtin_sub_overflow(x, y, &r); }
+        double operator()(double x, double y) const { return x - y; }
+    };
+    struct Times {
+        bool operator()(long long x, long long y, long long& r) const { return !__builtin_mul_overflow(x, y, &r); }
+        double operator()(double x, double y) const { return x * y; }
+    };
+    struct Over {
+        bool operator()(long long x, long long y, long long& r) const {
+            if (y == 0 || (y == -1 && x == LLONG_MIN) || x % y != 0) return false;
+            r = x / y;
+            return true;
+        }
+        double operator()(double x, double y) const { return x / y; }  // unchecked divide by 0
+    };
+
+    // (op x y ...) left to right, exact while the operands are integers and each step gives one,
+    // in doubles from the first step that doesn't
+    template <typename Op>
+    Cell fold(const Cell* a, const Cell* e, Op op) {
+        double x;
+        if (a->kind == Kind::Integer) {
+            long long n {a->fixnum()}, r;
+            while (++a != e && a->kind == Kind::Integer && op(n, a->fixnum(), r)) n = r;
+            if (a == e) return Cell{n};
+            x = n;
+        }
+        else x = (a++)->num();
+        for (; a != e; ++a) x = op(x, a->num());
+        return Cell{x};
+    }
 }
 #endif
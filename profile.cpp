@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include "profile.h"
+#include "interpreter.h"
+#include "error.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace Profile;
+
+namespace {
+    long long now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    size_t allocated() { return Interpreter::current().heap.stats.allocated; }
+
+    bool same(const Cell& a, const Cell& b) {   // the same list of the program, atoms are told apart by the other part
+        return a.kind == b.kind && (a.kind != Kind::Expr || a.seq() == b.seq());
+    }
+}
+
+size_t Profiler::Hash::operator()(const Key& k) const {
+    return hash<size_t>()(k.label) ^ size_t(k.kind);
+}
+
+size_t Profiler::Edge_hash::operator()(const Edge& e) const {
+    return Hash{}(e.key) * 31 + e.parent;
+}
+
+void Profiler::start() {
+    if (open_sessions++) return;
+    entries.clear();
+    edges.clear();
+    open.clear();
+    labels.clear();
+    names.clear();
+    named.clear();
+    nodes.assign(1, Node{Key{0, Kind::Undefined}, 0, 0});
+    began = now();
+    on = true;
+}
+
+void Profiler::stop(ostream& os) {
+    if (open_sessions == 0 || --open_sessions) return;
+    unwind(0);
+    on = false;
+    report(os);
+    ofstream out {folded_path};
+    if (out) folded(out);
+    else os << "cannot write " << folded_path << '\n';
+    labels.clear();     // releasing the lists they hold
+}
+
+void Profiler::enter(const Proc* p) {
+    auto l = labels.find(p);
+    if (l != labels.end() && same(l->second.params, p->params) && same(l->second.body, p->body))
+        enter(Key{l->second.label, Kind::Proc});
+    else enter(Key{label(p), Kind::Proc});
+}
+
+size_t Profiler::label(const Proc* p) {     // the procedure's global binding if it has one, else its lambda list
+    string n;
+    Interpreter::current().e0.bindings([p, &n](const Symbol* s, const Cell& c) {
+        if (n.empty() && c.kind == Kind::Proc && c.proc() == p) n = s->name;
+    });
+    if (n.empty()) {
+        string params;
+        for (auto& x : p->params.list()) params += (params.empty()? "" : " ") + x.name();
+        n = "(lambda (" + params + "))";
+    }
+    auto found = named.emplace(n, names.size());
+    if (found.second) names.push_back(n);
+    labels[p] = Label{p->params, p->body, found.first->second};
+    return found.first->second;
+}
+
+void Profiler::enter(const Key& k) {
+    Entry& e = entries[k];  // elements of an unordered_map stay put as it grows
+    ++e.calls;
+    ++e.active;
+    size_t parent {open.empty()? 0 : open.back().node};
+    auto edge = edges.find(Edge{parent, k});
+    size_t node;
+    if (edge != edges.end()) node = edge->second;
+    else {
+        node = nodes.size();
+        nodes.push_back({k, parent, 0});
+        edges.emplace(Edge{parent, k}, node);
+    }
+    open.push_back({&e, node, now(), 0, allocated(), 0});
+}
+
+void Profiler::exit() {
+    if (open.empty()) return;
+    Open o {open.back()};
+    open.pop_back();
+    long long spent {now() - o.start};
+    size_t allocs {allocated() - o.allocs};
+    o.entry->self += spent - o.children;
+    o.entry->allocs += allocs - o.child_allocs;
+    if (--o.entry->active == 0) o.entry->inclusive += spent;
+    nodes[o.node].self += spent - o.children;
+    if (!open.empty()) {
+        open.back().children += spent;
+        open.back().child_allocs += allocs;
+    }
+}
+
+string Profiler::name(const Key& k) const {
+    if (k.kind == Kind::Proc) return names[k.label];
+    string n(1, static_cast<char>(k.kind));     // the keyword spelling it, or the operator
+    for (auto& w : keywords) if (w.second == k.kind && w.first != "not") n = w.first;
+    return n;
+}
+
+void Profiler::report(ostream& os) const {
+    unordered_map<string, Entry> totals;    // procedures of the same name, such as closures of one lambda, together
+    vector<string> order;
+    size_t calls {0};
+    for (auto& e : entries) {
+        string n {name(e.first)};
+        calls += e.second.calls;
+        auto t = totals.find(n);
+        if (t == totals.end()) { totals[n] = e.second; order.push_back(n); continue; }
+        t->second.calls += e.second.calls;
+        t->second.inclusive += e.second.inclusive;
+        t->second.self += e.second.self;
+        t->second.allocs += e.second.allocs;
+    }
+    sort(order.begin(), order.end(), [&totals](const string& a, const string& b) { return totals[a].self > totals[b].self; });
+    ios::fmtflags flags {os.flags()};
+    os << fixed << setprecision(3) << "profile: " << (now() - began) / 1e6 << " ms, " << calls << " calls\n";
+    os << setw(12) << "calls" << setw(14) << "total ms" << setw(14) << "self ms" << setw(10) << "allocs" << "  name\n";
+    for (auto& n : order) {
+        const Entry& t = totals[n];
+        os << setw(12) << t.calls << setw(14) << t.inclusive / 1e6 << setw(14) << t.self / 1e6 << setw(10) << t.allocs << "  " << n << '\n';
+    }
+    os.flags(flags);
+}
+
+void Profiler::folded(ostream& os) const {
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        if (nodes[i].self <= 0) continue;
+        string stack;
+        for (size_t n = i; n != 0; n = nodes[n].parent)
+            stack = name(nodes[n].key) + (stack.empty()? "" : ";") + stack;
+        os << stack << ' ' << nodes[i].self << '\n';
+    }
+}
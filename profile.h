@@ -0,0 +1,106 @@
+#ifndef clispp_profile
+#define clispp_profile
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "lexer.h"
+
+// call counts, inclusive and self time and heap allocations per procedure and per primitive, for -prof and (profile expr).
+// the evaluators report calls only while a profile is being taken, costing them a test of on otherwise
+namespace Profile {
+    using namespace std;
+    using Lexer::Cell;
+    using Lexer::Kind;
+    using Lexer::Proc;
+
+    struct Key {    // the name of a procedure, or the primitive kind
+        size_t label;   // into the names of the profile, for Kind::Proc
+        Kind kind;
+        bool operator==(const Key& k) const { return label == k.label && kind == k.kind; }
+    };
+
+    struct Entry {
+        size_t calls {0};
+        long long inclusive {0};    // ns, counted once for recursive calls
+        long long self {0};         // ns, leaving out the calls it made
+        size_t allocs {0};          // environments and procedures allocated on the heap by the call itself
+        size_t active {0};          // calls under way
+    };
+
+    class Profiler {    // of one interpreter
+    public:
+        bool on {false};
+        string folded_path {"clisp.folded"};    // where stacks go for flamegraph.pl when a profile ends
+
+        void start();   // a profile, nested ones are part of the outermost
+        void stop(ostream& os);     // reports on os and writes folded_path when the outermost ends
+        size_t sessions() const { return open_sessions; }
+
+        void enter(const Proc* p);
+        void enter(Kind k) { enter(Key{0, k}); }
+        void exit();    // of the latest call entered
+        size_t depth() const { return open.size(); }
+        void unwind(size_t to) { while (open.size() > to) exit(); }     // calls abandoned by an exception
+
+        void report(ostream& os) const;     // table by self time
+        void folded(ostream& os) const;     // one line per call stack with its self time in ns
+    private:
+        struct Hash { size_t operator()(const Key& k) const; };
+        struct Node {   // call tree, 0 is the root
+            Key key;
+            size_t parent;
+            long long self;
+        };
+        struct Edge {
+            size_t parent;
+            Key key;
+            bool operator==(const Edge& e) const { return parent == e.parent && key == e.key; }
+        };
+        struct Edge_hash { size_t operator()(const Edge& e) const; };
+        struct Label {  // of a procedure, named when first entered since its slot can be reused once it is collected
+            Cell params, body;  // held, so another procedure in the slot is told apart by them
+            size_t label;
+        };
+        struct Open {
+            Entry* entry;
+            size_t node;
+            long long start, children;
+            size_t allocs, child_allocs;
+        };
+
+        void enter(const Key& k);
+        size_t label(const Proc* p);
+        string name(const Key& k) const;
+
+        unordered_map<Key, Entry, Hash> entries;
+        vector<Node> nodes;
+        unordered_map<Edge, size_t, Edge_hash> edges;
+        vector<Open> open;
+        size_t open_sessions {0};
+        long long began {0};
+        unordered_map<const Proc*, Label> labels;
+        vector<string> names;   // of the procedures entered, by label
+        unordered_map<string, size_t> named;
+    };
+
+    class Call {    // a call entered for the scope of the evaluator's C++ code, if a profile is being taken
+    public:
+        explicit Call(Profiler& p) : prof(p) {}
+        template <typename K>
+        Call(Profiler& p, K k) : prof(p) { enter(k); }
+        ~Call() { if (entered) prof.exit(); }
+        template <typename K>
+        void enter(K k) {   // ends the one entered before, as for a call in tail position
+            if (entered) prof.exit();
+            entered = prof.on;
+            if (entered) prof.enter(k);
+        }
+        Call(const Call&) = delete;
+        Call& operator=(const Call&) = delete;
+    private:
+        Profiler& prof;
+        bool entered {false};
+    };
+}
+#endif
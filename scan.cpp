@@ -0,0 +1,122 @@
+#include <cstring>
+#include "scan.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLISP_X86
+#endif
+
+namespace {
+    using Scan::Level;
+
+    inline bool space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+    uint64_t spaces_scalar(const char* p, const char* end) {
+        uint64_t mask {0};
+        size_t n = end - p < 64? end - p : 64;
+        for (size_t i = 0; i < n; ++i)
+            if (space(p[i])) mask |= uint64_t{1} << i;
+        if (n < 64) mask |= ~uint64_t{0} << n;
+        return mask;
+    }
+
+    const char* newline_scalar(const char* p, const char* end) {
+        while (p != end && *p != '\n') ++p;
+        return p;
+    }
+
+#ifdef CLISP_X86
+    // whitespace is ' ' or '\t' to '\r', the latter found as c - '\t' <= 4 unsigned
+    inline uint32_t spaces16(const char* p) {
+        __m128i v {_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))};
+        __m128i x {_mm_sub_epi8(v, _mm_set1_epi8('\t'))};
+        __m128i ctl {_mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(4)), x)};
+        return _mm_movemask_epi8(_mm_or_si128(ctl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' '))));
+    }
+
+    uint64_t spaces_sse2(const char* p, const char* end) {
+        char padded[64];
+        if (end - p < 64) {     // copy what is left so the loads stay inside
+            memset(padded, ' ', 64);
+            memcpy(padded, p, end - p);
+            p = padded;
+        }
+        return uint64_t{spaces16(p)} | uint64_t{spaces16(p + 16)} << 16
+            | uint64_t{spaces16(p + 32)} << 32 | uint64_t{spaces16(p + 48)} << 48;
+    }
+
+    const char* newline_sse2(const char* p, const char* end) {
+        const __m128i nl {_mm_set1_epi8('\n')};
+        for (; end - p >= 16; p += 16) {
+            uint32_t m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), nl));
+            if (m) return p + __builtin_ctz(m);
+        }
+        return newline_scalar(p, end);
+    }
+
+    __attribute__((target("avx2"))) inline uint32_t spaces32(const char* p) {
+        __m256i v {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))};
+        __m256i x {_mm256_sub_epi8(v, _mm256_set1_epi8('\t'))};
+        __m256i ctl {_mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(4)), x)};
+        return _mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '))));
+    }
+
+    __attribute__((target("avx2"))) uint64_t spaces_avx2(const char* p, const char* end) {
+        char padded[64];
+        if (end - p < 64) {
+            memset(padded, ' ', 64);
+            memcpy(padded, p, end - p);
+            p = padded;
+        }
+        return uint64_t{spaces32(p)} | uint64_t{spaces32(p + 32)} << 32;
+    }
+
+    __attribute__((target("avx2"))) const char* newline_avx2(const char* p, const char* end) {
+        const __m256i nl {_mm256_set1_epi8('\n')};
+        for (; end - p >= 32; p += 32) {
+            uint32_t m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), nl));
+            if (m) return p + __builtin_ctz(m);
+        }
+        return newline_sse2(p, end);
+    }
+#endif
+
+    Level in_use {Level::Scalar};
+}
+
+uint64_t (*Scan::spaces)(const char*, const char*) {spaces_scalar};
+const char* (*Scan::newline)(const char*, const char*) {newline_scalar};
+
+namespace {
+    struct Startup { Startup() { Scan::select(Scan::best()); } } startup;
+}
+
+Level Scan::best() {
+#ifdef CLISP_X86
+    if (__builtin_cpu_supports("avx2")) return Level::AVX2;
+    if (__builtin_cpu_supports("sse2")) return Level::SSE2;
+#endif
+    return Level::Scalar;
+}
+
+Level Scan::level() {
+    return in_use;
+}
+
+void Scan::select(Level l) {
+    in_use = l;
+    switch (l) {
+#ifdef CLISP_X86
+        case Level::AVX2: spaces = spaces_avx2; newline = newline_avx2; return;
+        case Level::SSE2: spaces = spaces_sse2; newline = newline_sse2; return;
+#endif
+        default: in_use = Level::Scalar; spaces = spaces_scalar; newline = newline_scalar;
+    }
+}
+
+const char* Scan::name(Level l) {
+    switch (l) {
+        case Level::AVX2: return "avx2";
+        case Level::SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
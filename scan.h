@@ -0,0 +1,21 @@
+#ifndef clispp_scan
+#define clispp_scan
+#include <cstdint>
+#include <cstddef>
+
+// byte classification for the lexer, done 16 or 32 bytes at a time where the cpu allows.
+// the best implementation is selected when the program starts
+namespace Scan {
+    enum class Level { Scalar, SSE2, AVX2 };
+
+    // bit i set if p[i] is whitespace, for the 64 bytes from p or up to end, bits past end are set
+    extern uint64_t (*spaces)(const char* p, const char* end);
+    // first newline from p, or end
+    extern const char* (*newline)(const char* p, const char* end);
+
+    Level best();           // most capable implementation this cpu runs
+    Level level();          // implementation in use
+    void select(Level l);   // not thread safe, for comparing implementations before interpreters start
+    const char* name(Level l);
+}
+#endif
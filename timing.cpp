@@ -1,62 +1,269 @@
 #include <fstream>
+#include <sstream>
 #include <chrono>
+#include <algorithm>
+#include <random>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "interpreter.h"
 #include "parser.h"
-#include "lexer.h"
-#include "environment.h"
+#include "compiler.h"
+#include "scan.h"
+#include "counters.h"
 #include "error.h"
 
 using namespace Lexer;
-using namespace Parser;
-using namespace Environment;
-
-namespace Driver {
-    void start(bool print_res) {
-        envs.reserve(max_capacity * 4); // reserve to preserve pointers
-        procs.reserve(max_capacity);
-        envs.push_back(e0);
-
-        while (true) {
-            if (print_res) cout << "> ";
-            try {
-                chrono::time_point<chrono::system_clock> start, end;
-                auto read = expr(true);
-                start = chrono::system_clock::now();
-                auto res = eval(read, &e0);
-                end = chrono::system_clock::now();
-                chrono::duration<double> elapsed = chrono::duration_cast<chrono::milliseconds>(end - start);
-                if (print_res) {
-                    cout << res << '\n';    
-                    cout << "Took: " << elapsed.count() << "ms\n";
+
+// benchmark driver, each file of the corpus is loaded once then (bench) is timed
+// usage: clisp-bench [-reps n] [-warmup n] [-ref] [-nojit] [-verify] [-counters] [-o file.json] files...
+// -counters adds the hardware counts of an average repetition, where the kernel lets them be read
+// -verify also runs each file once without machine code and fails if any value differs
+// or clisp-bench -lex mb [-reps n] [-o file.json] to time the lexer on mb megabytes of generated numeric lists
+namespace Bench {
+    struct Options {
+        int reps {10};
+        int warmup {2};
+        bool reference {false};    // time Parser::eval instead of the VM
+        bool jit {true};
+        bool verify {false};
+        bool counters {false};
+    };
+
+    struct Result {
+        string name;
+        string value;   // printed result of the last run, to catch benchmarks that went wrong
+        string error;
+        vector<double> ns;      // one sample per repetition
+        long peak_rss_kb {0};
+        bool own_peak {false};  // peak_rss_kb is of this run alone, otherwise of the process so far
+        Counters::Sample counts;    // summed over the repetitions
+    };
+
+    bool reset_peak() {     // peak RSS measured from here on, false where the kernel doesn't support it
+#ifdef __GLIBC__
+        malloc_trim(0);     // return what earlier runs freed, or it stays resident and counts towards this one
+#endif
+        ofstream clear {"/proc/self/clear_refs"};
+        clear << "5" << flush;
+        return bool(clear);
+    }
+
+    long peak_rss_kb() {
+        ifstream status {"/proc/self/status"};
+        string line;
+        while (getline(status, line))
+            if (line.compare(0, 6, "VmHWM:") == 0) return stol(line.substr(6));
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    void load(Interpreter& clisp, const string& file) {    // evaluates every expression of file, following includes
+        Cell_stream& cs = clisp.cs;
+        cs.open(file);
+        while (!cs.base()) {
+            auto read = clisp.expr();
+            auto res = clisp.eval(read);   // by the evaluator being timed
+            if (res.kind == Kind::End || cs.eof()) cs.reset();
+        }
+    }
+
+    string name_of(const string& file) {
+        size_t slash {file.find_last_of('/')};
+        string name {slash == string::npos? file : file.substr(slash + 1)};
+        return name.substr(0, name.rfind(".scm"));
+    }
+
+    Result run(const string& file, const Options& opt) {   // in an interpreter of its own
+        Result r;
+        r.name = name_of(file);
+        r.own_peak = reset_peak();
+        ostringstream printed;
+        Interpreter clisp {cin, printed};
+        clisp.reference = opt.reference;
+        clisp.jit = clisp.jit && opt.jit;
+        Interpreter::Use use {clisp};
+        try {
+            load(clisp, file);
+            const List call {Cell{intern("bench")}};
+            auto code = Compiler::compile(call);
+            Cell value;
+            unique_ptr<Counters::Group> counters {opt.counters? new Counters::Group : nullptr};
+            for (int i = 0; i < opt.warmup + opt.reps; ++i) {
+                if (counters) counters->start();
+                auto start = chrono::steady_clock::now();
+                value = opt.reference? Parser::eval(call, &clisp.e0) : VM::run(*code, &clisp.e0);
+                auto end = chrono::steady_clock::now();
+                if (counters && i >= opt.warmup) r.counts += counters->stop();
+                if (i >= opt.warmup) r.ns.push_back(chrono::duration<double, nano>(end - start).count());
+            }
+            printed.str("");
+            print(value);
+            r.value = printed.str();
+            while (r.value.size() && r.value.back() == ' ') r.value.pop_back();
+        }
+        catch (exception& e) {
+            r.error = e.what();
+        }
+        r.peak_rss_kb = peak_rss_kb();
+        return r;
+    }
+
+    double percentile(vector<double> ns, double p) {   // nearest rank
+        sort(ns.begin(), ns.end());
+        size_t rank = p * ns.size() + 0.5;
+        return ns[rank > 0? min(rank, ns.size()) - 1 : 0];
+    }
+
+    string quoted(const string& s) {
+        string q {"\""};
+        for (char c : s) {
+            if (c == '"' || c == '\\') q += '\\';
+            if (static_cast<unsigned char>(c) < ' ') { q += ' '; continue; }
+            q += c;
+        }
+        return q + '"';
+    }
+
+    void report(ostream& os, const vector<Result>& results, const Options& opt) {
+        os << "{\n  \"evaluator\": " << quoted(opt.reference? "ref" : "vm") << ",\n  \"jit\": " << (opt.jit && JIT::supported()? "true" : "false")
+           << ",\n  \"warmup\": " << opt.warmup << ",\n  \"reps\": " << opt.reps << ",\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            os << (i? ",\n" : "\n") << "    {\"name\": " << quoted(r.name);
+            if (r.error.size()) os << ", \"error\": " << quoted(r.error);
+            else {
+                double mean {0};
+                for (double t : r.ns) mean += t / r.ns.size();
+                os << fixed;
+                os.precision(0);
+                os << ", \"median_ns\": " << percentile(r.ns, 0.5) << ", \"p95_ns\": " << percentile(r.ns, 0.95)
+                   << ", \"min_ns\": " << percentile(r.ns, 0) << ", \"mean_ns\": " << mean;
+                for (int e = 0; e < Counters::events; ++e) {
+                    if (!r.counts.counted[e]) continue;
+                    string n {Counters::name(Counters::Event(e))};
+                    replace(n.begin(), n.end(), '-', '_');
+                    os << ", \"" << n << "\": " << double(r.counts.value[e]) / r.ns.size();
                 }
-                if (res.kind == Kind::End || cs.eof()) { cs.reset(); if (cs.base()) print_res = true; }
+                os.unsetf(ios::floatfield);
+                if (r.counts.ipc()) os << ", \"ipc\": " << r.counts.ipc();
+                os << ", \"value\": " << quoted(r.value);
             }
-            catch (exception& e) {
-                cout << "Bad expression: " << e.what() << endl;    // continue loop
+            os << (r.own_peak? ", \"peak_rss_kb\": " : ", \"process_peak_rss_kb\": ") << r.peak_rss_kb << "}";
+        }
+        os << "\n  ]\n}\n";
+    }
+}
+
+// lexer throughput on data files made of long quoted lists of numbers, with each scanner the cpu runs
+namespace Lex {
+    string generate(size_t mb) {    // temporary file of about mb megabytes
+        char path[] {"/tmp/clisp-lex-XXXXXX"};
+        int fd {mkstemp(path)};
+        if (fd < 0) throw runtime_error("cannot create a temporary file");
+        close(fd);
+        ofstream out {path};
+        mt19937 random {42};
+        size_t written {0};
+        for (size_t line = 0; written < mb << 20; ++line) {
+            ostringstream l;
+            l << "(define data-" << line << " '(";
+            for (int i = 0; i < 24; ++i) {
+                if (i) l << ' ';
+                if (random() % 2) l << random() % 100000;
+                else l << random() % 1000 << '.' << random() % 100;
             }
+            l << ")) ; row " << line << '\n';
+            out << l.str();
+            written += l.str().size();
         }
+        return path;
+    }
+
+    void run(ostream& os, size_t mb, int reps) {
+        string path {generate(mb)};
+        os << "{\n  \"lexer\": {\"megabytes\": " << mb << ", \"reps\": " << reps << ", \"scanners\": [";
+        for (int l = 0; l <= int(Scan::best()); ++l) {
+            Scan::select(Scan::Level(l));
+            vector<double> ns;
+            size_t tokens {0};
+            for (int i = 0; i < reps; ++i) {
+                Interpreter clisp;
+                Interpreter::Use use {clisp};
+                auto start = chrono::steady_clock::now();
+                clisp.cs.open(path);
+                for (tokens = 0; clisp.cs.get().kind != Kind::End; ++tokens) ;
+                ns.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+            }
+            double median {Bench::percentile(ns, 0.5)};
+            os << (l? ",\n" : "\n") << "    {\"scanner\": \"" << Scan::name(Scan::Level(l)) << "\", \"tokens\": " << tokens;
+            os << fixed;
+            os.precision(0);
+            os << ", \"median_ns\": " << median << ", \"min_ns\": " << Bench::percentile(ns, 0);
+            os.precision(1);
+            os << ", \"mb_per_s\": " << (mb << 20) / (median / 1e9) / (1 << 20) << "}";
+            os.unsetf(ios::floatfield);
+        }
+        os << "\n  ]}\n}\n";
+        Scan::select(Scan::best());
+        unlink(path.c_str());
     }
 }
 
 int main(int argc, char* argv[]) {
-    bool print_res {false};
-    switch (argc) {
-        case 1:
-            print_res = true;
-            break;
-        case 2:
-            cs.set_input(new ifstream{argv[1]});
-            break;
-        case 3: {
-            cs.set_input(new ifstream{argv[1]});
-            string option {argv[2]};
-            if (option == "-p" || option == "-print") print_res = true;
-            break;
-        }
-        default:
-            throw runtime_error("too many arguments");
-            return 1;
-    }
-    Driver::start(print_res);
-
-    return 0;
+    Bench::Options opt;
+    string output;
+    vector<string> files;
+    size_t lex_mb {0};
+    for (int i = 1; i < argc; ++i) {
+        string option {argv[i]};
+        if (option == "-reps" && i + 1 < argc) opt.reps = stoi(argv[++i]);
+        else if (option == "-lex" && i + 1 < argc) lex_mb = stoul(argv[++i]);
+        else if (option == "-warmup" && i + 1 < argc) opt.warmup = stoi(argv[++i]);
+        else if (option == "-ref") opt.reference = true;
+        else if (option == "-nojit") opt.jit = false;
+        else if (option == "-verify") opt.verify = true;
+        else if (option == "-counters") opt.counters = true;
+        else if (option == "-o" && i + 1 < argc) output = argv[++i];
+        else if (option[0] == '-') throw runtime_error("unrecognized argument " + option);
+        else files.push_back(option);
+    }
+    if (opt.reps < 1) throw runtime_error("-reps must be at least 1");
+
+    ofstream out;
+    if (!output.empty()) out.open(output);
+    ostream& os = output.empty()? cout : out;
+    if (lex_mb) {
+        Lex::run(os, lex_mb, opt.reps);
+        return 0;
+    }
+
+    if (opt.counters) {
+        Counters::Group probe;
+        if (!probe.available()) cerr << "counters unavailable, " << probe.reason() << '\n';
+        opt.counters = probe.available();
+    }
+
+    vector<Bench::Result> results;
+    int status {0};
+    for (auto& file : files) {
+        results.push_back(Bench::run(file, opt));
+        const Bench::Result& r = results.back();
+        cerr << r.name << (r.error.size()? " failed: " + r.error : "") << '\n';
+        if (!opt.verify) continue;
+        Bench::Options plain {opt};
+        plain.jit = false;
+        plain.reps = 1;
+        plain.warmup = 0;
+        Bench::Result check {Bench::run(file, plain)};
+        if (check.value != r.value || check.error != r.error) {
+            cerr << r.name << " differs without machine code: " << (check.error.size()? check.error : check.value) << '\n';
+            status = 1;
+        }
+    }
+    Bench::report(os, results, opt);
+    return status;
 }
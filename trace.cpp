@@ -0,0 +1,80 @@
+#include <iostream>
+#include "trace.h"
+#include "bytecode.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace Bytecode;
+
+namespace {
+    const char* const ops[] {"Const", "Name", "Local", "Checked", "Head", "HeadLocal", "HeadChecked", "Prim", "Mark",
+        "Resolve", "Tail", "Collect", "Drop", "Pop", "Jump", "False", "Lambda", "Define", "DefineLocal", "Let", "Unlet",
+        "Include", "Profile", "Unprofile", "Return", "Error"};
+    static_assert(sizeof(ops) / sizeof(ops[0]) == size_t(Op::Error) + 1, "a name for every op");
+
+    ostream& line(size_t depth) {
+        for (size_t i = 0; i < depth; ++i) cerr << "  ";
+        return cerr;
+    }
+
+    void cells(const Cell* a, const Cell* e) {
+        cerr << '(';
+        for (auto p = a; p != e; ++p) {
+            if (p != a) cerr << ' ';
+            print(cerr, *p);
+        }
+        cerr << ')';
+    }
+}
+
+void Trace::eval(const Cell* b, const Cell* e, size_t depth) {
+    line(depth) << "eval ";
+    cells(b, e);
+    cerr << '\n';
+}
+
+void Trace::evlist(const Cell* b, const Cell* e, size_t depth) {
+    line(depth) << "evlist ";
+    cells(b, e);
+    cerr << '\n';
+}
+
+void Trace::apply(const Proc& proc, const List& args) {
+    cerr << "apply ";
+    print(cerr, proc.params);
+    cerr << " to ";
+    cells(args.data(), args.data() + args.size());
+    cerr << '\n';
+}
+
+void Trace::prim(Kind k, const Cell* a, const Cell* e, const Cell& res) {
+    cerr << "prim ";
+    print(cerr, Cell{k});
+    cells(a, e);
+    cerr << " => ";
+    print(cerr, res);
+    cerr << '\n';
+}
+
+void Trace::env(const Env* made, const Env* outer, size_t slots) {
+    cerr << "env " << made << " in " << outer << ", " << slots << " slots\n";
+}
+
+void Trace::step(const Code& code, size_t pc, size_t stack, size_t depth) {
+    const Instr& in = code.instrs[pc];
+    line(depth) << pc << ' ' << ops[size_t(in.op)] << ' ' << in.a << ' ' << in.b << "  stack " << stack << '\n';
+}
+
+void Trace::call(const Proc& proc, const Cell* a, const Cell* e, size_t depth) {
+    line(depth) << "call ";
+    print(cerr, proc.params);
+    cerr << " with ";
+    cells(a, e);
+    cerr << '\n';
+}
+
+void Trace::ret(const Cell& res, size_t depth) {
+    line(depth) << "return ";
+    print(cerr, res);
+    cerr << '\n';
+}
@@ -0,0 +1,31 @@
+#ifndef clispp_trace
+#define clispp_trace
+#include "forward.h"
+#include "lexer.h"
+
+#ifndef CLISP_TRACE
+#define CLISP_TRACE 0
+#endif
+
+// step by step output of the evaluators on stderr, for debugging the engine that ships rather than a copy of it.
+// built in by make trace (-DCLISP_TRACE), otherwise every hook is behind a false constant and compiles to nothing
+namespace Trace {
+    using Lexer::Cell;
+    using Lexer::Kind;
+    using Lexer::List;
+    using Lexer::Proc;
+    using Environment::Env;
+
+    constexpr bool enabled {CLISP_TRACE != 0};
+
+    // depth is the nesting of Parser::eval or of VM frames, shown as indentation
+    void eval(const Cell* b, const Cell* e, size_t depth);     // a form about to be evaluated by Parser::eval
+    void evlist(const Cell* b, const Cell* e, size_t depth);
+    void apply(const Proc& proc, const List& args);
+    void prim(Kind k, const Cell* a, const Cell* e, const Cell& res);  // primitive called on a to e, giving res
+    void env(const Env* made, const Env* outer, size_t slots);   // environment created
+    void step(const Bytecode::Code& code, size_t pc, size_t stack, size_t depth);  // VM instruction about to run
+    void call(const Proc& proc, const Cell* a, const Cell* e, size_t depth);   // procedure entered by the VM
+    void ret(const Cell& res, size_t depth);
+}
+#endif
@@ -0,0 +1,296 @@
+#include <sstream>
+#include "vm.h"
+#include "compiler.h"
+#include "parser_impl.h"
+#include "gc.h"
+#include "jit.h"
+#include "interpreter.h"
+#include "error.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace Environment;
+using namespace Bytecode;
+using namespace VM;
+
+namespace {
+    const Code& code_of(Proc& proc) {
+        if (!proc.code) proc.code = Compiler::compile(proc.params.list(), proc.body.list());
+        return *proc.code;
+    }
+
+    Cell& global(const Global& g, Env* env) {
+        Env* start {env->up(g.depth)};
+        if (g.start == start) return *g.cell;
+        Cell& x = start->lookup(g.name);
+        if (start->outermost()) { g.start = start; g.cell = &x; }  // nothing can shadow it later
+        return x;
+    }
+
+    Cell& checked(const Code& c, int i, Env* env) {
+        for (auto& a : c.addrs[i]) {
+            if (a.slot < 0) return global(c.globals[-1 - a.slot], env);
+            Cell& x = env->up(a.depth)->slot(a.slot);
+            if (x.kind != Kind::Undefined) return x;
+        }
+        throw runtime_error("Unbound variable");
+    }
+
+    // arithmetic and comparisons done without going through the primitive's executor or checking each number
+    // again, false if an operand is not a number or the primitive is not one of them
+    bool numeric(Kind k, const Cell* a, const Cell* e, Cell& res) {
+        if (a == e) return false;
+        for (auto p = a; p != e; ++p)
+            if (!p->numeric()) return false;
+        switch (k) {
+            case Kind::Add: res = Parser::fold(a, e, Parser::Plus{}); return true;
+            case Kind::Sub: res = Parser::fold(a, e, Parser::Minus{}); return true;
+            case Kind::Mul: res = Parser::fold(a, e, Parser::Times{}); return true;
+            case Kind::Div: res = Parser::fold(a, e, Parser::Over{}); return true;
+            case Kind::Less: case Kind::Greater: case Kind::Equal: {
+                if (e - a < 2) return false;
+                if (a[0].kind == Kind::Integer && a[1].kind == Kind::Integer) {    // exactly
+                    long long x {a[0].fixnum()}, y {a[1].fixnum()};
+                    res = Cell{k == Kind::Less? x < y : k == Kind::Greater? y < x : x == y};
+                    return true;
+                }
+                double x {a[0].num()}, y {a[1].num()};
+                if (k == Kind::Less) res = Cell{x < y};
+                else if (k == Kind::Greater) res = Cell{y < x};
+                else res = Cell{x < y? y - x < equal_threshold : x - y < equal_threshold};
+                return true;
+            }
+            default: return false;
+        }
+    }
+
+    Cell& local(int addr, Env* env) {
+        return env->up(addr >> 16)->slot(addr & 0xffff);
+    }
+
+    // new frame holding the values from args to top of stack, from the region unless code that may capture it runs in it
+    Env* frame(vector<Cell>& stack, const Layout& layout, size_t args, Env* outer, Region* region) {
+        if (stack.size() - args != layout.bind.size()) {
+            stringstream msg; msg << "provided args : " << stack.size() - args << " expected: " << layout.bind.size();
+            throw runtime_error(msg.str());
+        }
+        Env* f {region? region->frame(layout.size, outer) : GC::env(layout.size, outer)};
+        for (size_t i = 0; i < layout.bind.size(); ++i)
+            f->slot(layout.bind[i]) = move(stack[args + i]);
+        stack.resize(args);
+        return f;
+    }
+}
+
+Cell VM::run(const Code& code, Env* env) {
+    Interpreter& in_use = Interpreter::current();
+    vector<Cell>& stack = in_use.vm.stack;
+    vector<Mark>& marks = in_use.vm.marks;
+    vector<Frame>& frames = in_use.vm.frames;
+    Region& region = in_use.vm.region;
+    Profile::Profiler& prof = in_use.profiler;
+    const size_t entry {frames.size()};
+    const size_t stack_entry {stack.size()}, marks_entry {marks.size()}, region_entry {region.top()};
+    const size_t prof_depth {prof.depth()}, prof_sessions {prof.sessions()};
+    frames.push_back({&code, 0, env, stack.size(), marks.size(), region.top(), false});
+
+    const Code* c {&code};
+    const Instr* ip {c->instrs.data()};
+    bool prefix {false};   // simple arguments directly after a procedure are not applied themselves
+    try {
+        while (true) {
+            const Instr& in = *ip;
+            if (Trace::enabled) Trace::step(*c, ip - c->instrs.data(), stack.size(), frames.size());
+            switch (in.op) {
+                case Op::Const: stack.push_back(c->consts[in.a]); break;
+                case Op::Name: case Op::Local: case Op::Checked: {
+                    const Cell& x = in.op == Op::Local? local(in.a, env) : in.op == Op::Name? global(c->globals[in.a], env) : checked(*c, in.a, env);
+                    if (x.kind == Kind::Proc && !prefix) { marks.push_back({stack.size(), false}); prefix = true; }
+                    stack.push_back(x);
+                    break;
+                }
+                case Op::Head: case Op::HeadLocal: case Op::HeadChecked: {
+                    const Cell& x = in.op == Op::HeadLocal? local(in.a, env) : in.op == Op::Head? global(c->globals[in.a], env) : checked(*c, in.a, env);
+                    stack.push_back(x);
+                    if (x.kind != Kind::Proc) { ip = c->instrs.data() + in.b; continue; }
+                    marks.push_back({stack.size() - 1, false});
+                    prefix = true;
+                    break;
+                }
+                case Op::Prim:
+                    marks.push_back({stack.size(), false, &in});
+                    stack.push_back(c->consts[in.a]);
+                    prefix = Parser::takes_procedure(c->consts[in.a].kind);
+                    break;
+                case Op::Mark: marks.push_back({stack.size(), true}); prefix = false; break;
+                case Op::Resolve:
+                case Op::Tail: {
+                    bool called {false};
+                    while (!marks.back().list) {
+                        Mark m {marks.back()};
+                        marks.pop_back();
+                        if (stack[m.pos].kind != Kind::Proc) {
+                            // arguments are taken where they lie on the stack, a site that has seen only
+                            // numbers tries the VM's own arithmetic first and stops once something else turns up
+                            const Cell* args {stack.data() + m.pos + 1};
+                            const Cell* end {stack.data() + stack.size()};
+                            Kind k {stack[m.pos].kind};
+                            Profile::Call call {prof, k};
+                            if (m.site->seen != Seen::Other) {
+                                if (numeric(k, args, end, stack[m.pos])) {  // over the primitive
+                                    if (Trace::enabled) Trace::prim(k, args, end, stack[m.pos]);
+                                    m.site->seen = Seen::Numbers;
+                                    stack.resize(m.pos + 1);
+                                    continue;
+                                }
+                                m.site->seen = Seen::Other;
+                            }
+                            Cell res {Parser::primitive(k)(args, end)};
+                            // a primitive applying procedures runs the VM again, which may have moved the stack
+                            if (Trace::enabled) Trace::prim(k, stack.data() + m.pos + 1, stack.data() + stack.size(), res);
+                            stack.resize(m.pos);
+                            stack.push_back(move(res));
+                            continue;
+                        }
+                        Proc& proc = *stack[m.pos].proc();
+                        if (Trace::enabled) Trace::call(proc, stack.data() + m.pos + 1, stack.data() + stack.size(), frames.size());
+                        if (in_use.jit && !prof.on && ++proc.calls >= JIT::hot) {   // profiles count every call
+                            Cell res;
+                            size_t depth {frames.size() < in_use.max_depth? in_use.max_depth - frames.size() : 0};
+                            if (JIT::call(proc, stack.data() + m.pos + 1, stack.data() + stack.size(), depth, res)) {
+                                if (Trace::enabled) Trace::ret(res, frames.size());
+                                stack.resize(m.pos);
+                                stack.push_back(move(res));
+                                continue;
+                            }
+                        }
+                        const Code& callee = code_of(proc);
+                        Frame& f = frames.back();
+                        bool reuse {in.op == Op::Tail && marks.back().list && marks.back().pos == m.pos && m.pos == f.base && marks.size() - 1 == f.markbase};
+                        if (reuse) {
+                            region.release(f.region);   // the arguments are all on the stack by now
+                            if (f.profiled) prof.exit();
+                        }
+                        else if (frames.size() >= in_use.max_depth) throw runtime_error("Recursion too deep");
+                        if (prof.on) prof.enter(&proc);     // allocating its frame is part of the call
+                        size_t height {region.top()};
+                        // proc.env is never in the region, as code that makes procedures gets frames from the heap
+                        Env* newenv {frame(stack, callee.frame, m.pos + 1, proc.env, callee.captures? nullptr : &region)};
+                        stack.pop_back();
+                        if (reuse) {
+                            marks.pop_back();   // nothing left to do in this frame, reuse it
+                            f.code = &callee;
+                            f.env = newenv;
+                            f.profiled = prof.on;
+                        }
+                        else {
+                            f.pc = ip - c->instrs.data();   // come back to this instruction to resolve the rest
+                            frames.push_back({&callee, 0, newenv, m.pos, marks.size(), height, prof.on});
+                        }
+                        c = &callee;
+                        ip = c->instrs.data();
+                        env = newenv;
+                        called = true;
+                        break;
+                    }
+                    if (called) continue;
+                    break;
+                }
+                case Op::Collect: {
+                    size_t pos {marks.back().pos};
+                    marks.pop_back();
+                    if (stack.size() - pos != 1) {
+                        Cell res {List{make_move_iterator(stack.begin() + pos), make_move_iterator(stack.end())}};
+                        stack.resize(pos);
+                        stack.push_back(move(res));
+                    }
+                    prefix = false;
+                    break;
+                }
+                case Op::Drop: stack.resize(marks.back().pos); marks.pop_back(); break;
+                case Op::Pop: stack.pop_back(); break;
+                case Op::Jump: ip = c->instrs.data() + in.a; continue;
+                case Op::False: {
+                    bool jump {stack.back().kind == Kind::False};
+                    stack.pop_back();
+                    if (jump) { ip = c->instrs.data() + in.a; continue; }
+                    break;
+                }
+                case Op::Lambda: {
+                    const Template& t = c->procs[in.a];
+                    stack.push_back({GC::proc(t.params, t.body, env, t.code)});    // introduce onto heap
+                    prefix = false;
+                    break;
+                }
+                case Op::Define: (*env)[c->names[in.a]] = stack.back(); break;
+                case Op::DefineLocal: env->slot(in.a) = stack.back(); break;
+                case Op::Let: {     // on the heap if it may be captured by a lambda in the body
+                    const Layout& l = c->lets[in.a];
+                    env = frames.back().env = frame(stack, l, stack.size() - l.bind.size(), env, c->captures? nullptr : &region);
+                    break;
+                }
+                case Op::Unlet: env = frames.back().env = env->parent(); break;
+                case Op::Include:
+                    in_use.cs.open(c->names[in.a]->name);
+                    stack.push_back({Kind::Include});
+                    break;
+                case Op::Profile: prof.start(); break;
+                case Op::Unprofile: prof.stop(*in_use.outstream); break;
+                case Op::Return: {
+                    Cell res {move(stack.back())};
+                    if (Trace::enabled) Trace::ret(res, frames.size() - 1);
+                    Frame& f = frames.back();
+                    stack.resize(f.base);
+                    marks.resize(f.markbase);
+                    region.release(f.region);
+                    if (f.profiled) prof.exit();
+                    frames.pop_back();
+                    if (frames.size() == entry) return res;
+                    stack.push_back(move(res));
+                    Frame& caller = frames.back();
+                    c = caller.code;
+                    ip = c->instrs.data() + caller.pc;
+                    env = caller.env;
+                    continue;
+                }
+                case Op::Error: throw runtime_error(c->consts[in.a].name());
+            }
+            ++ip;
+        }
+    }
+    catch (...) {   // unwind everything this run pushed
+        frames.resize(entry);
+        stack.resize(stack_entry);
+        marks.resize(marks_entry);
+        region.release(region_entry);
+        prof.unwind(prof_depth);
+        while (prof.sessions() > prof_sessions) prof.stop(*in_use.outstream);
+        throw;
+    }
+}
+
+void VM::mark() {
+    Machine& vm = Interpreter::current().vm;
+    for (auto& c : vm.stack) GC::mark(c);
+    for (auto& f : vm.frames) GC::mark(f.env);
+}
+
+Cell VM::eval(const List& expr, Env* env) {
+    auto code = Compiler::compile(expr);
+    return run(*code, env);
+}
+
+Cell VM::apply(const Cell& proc, List args) {
+    Code code;  // the procedure and arguments as constants, so none is applied as it is pushed
+    code.consts.reserve(args.size() + 1);
+    code.consts.push_back(proc);
+    for (auto& a : args) code.consts.push_back(move(a));
+    GC::Root root {code.consts};
+    code.instrs.push_back({Op::Mark, 0, 0});
+    code.instrs.push_back({Op::Prim, 0, 0});
+    for (size_t i = 1; i < code.consts.size(); ++i) code.instrs.push_back({Op::Const, int(i), 0});
+    code.instrs.push_back({Op::Resolve, 0, 0});
+    code.instrs.push_back({Op::Collect, 0, 0});
+    code.instrs.push_back({Op::Return, 0, 0});
+    return run(code, &Interpreter::current().e0);
+}
@@ -0,0 +1,59 @@
+#ifndef clispp_vm
+#define clispp_vm
+#include <deque>
+#include "bytecode.h"
+#include "environment.h"
+#include "trace.h"
+
+namespace VM {
+    using namespace Bytecode;
+    using Environment::Env;
+
+    struct Mark {
+        size_t pos;     // stack index of list start or of the procedure being called
+        bool list;
+        const Instr* site;  // Prim that made it, for calls of primitives
+    };
+
+    struct Frame {
+        const Code* code;
+        size_t pc;
+        Env* env;
+        size_t base;        // stack height on entry
+        size_t markbase;    // mark stack height on entry
+        size_t region;      // region height on entry
+        bool profiled;      // entered in the profile being taken
+    };
+
+    class Region {  // frames of code that makes no procedures, which die with the call, released in stack order
+    public:
+        Env* frame(size_t slots, Env* outer) {
+            if (used == envs.size()) envs.emplace_back();   // a deque never moves its elements
+            Env* e {&envs[used++]};
+            e->reset(slots, outer);
+            if (Trace::enabled) Trace::env(e, outer, slots);
+            return e;
+        }
+        size_t top() const { return used; }
+        void release(size_t to) {   // frames from to up, their cells at once, storage for the next calls
+            for (; used > to; --used) envs[used - 1].reset(0, nullptr);
+        }
+    private:
+        deque<Env> envs;
+        size_t used {0};
+    };
+
+    struct Machine {    // state of the VM of one interpreter
+        vector<Cell> stack;
+        vector<Mark> marks;
+        vector<Frame> frames;
+        Region region;
+    };
+
+    // run on the machine of the interpreter in use on this thread
+    Cell run(const Code& code, Env* env);   // executes compiled code, calls to procedures do not recurse natively
+    Cell eval(const List& expr, Env* env);  // compiles then runs an expression given back by Parser::expr()
+    Cell apply(const Cell& proc, List args);    // calls a procedure on evaluated arguments
+    void mark();    // report stack and frames to the collector
+}
+#endif